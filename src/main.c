@@ -18,17 +18,24 @@
 #define _GNU_SOURCE
 
 #include <stdio.h>
+#include <stdint.h>
 #include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <stdarg.h>
 #include <unistd.h>
 #include <string.h>
+#include <dirent.h>
 #include <sys/ioctl.h>
+#include <poll.h>
 #include <sys/types.h>
 #include <termios.h>
 #include <time.h>
+#include <pthread.h>
 #include <stdlib.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 // ======================================================================= //
 //                                Defines
@@ -40,12 +47,61 @@
 #define CTRL_KEY(k) ((k) & 0x1f)
 /** 制表位的长度常量 */
 #define TAB_STOP 8
-/** 如果设置了`ec.dirty`，将在状态栏中显示警告：要求用户再按`Ctrl-Q`两次才能退出而不保存 */
+/** 如果设置了`dirty`，将在状态栏中显示警告：要求用户再按`Ctrl-Q`两次才能退出而不保存 */
 #define QUIT_TIMES 2
+/** 输入环形缓冲区大小（须为 2 的幂） */
+#define INPUT_RING   4096
+/** 等待输入（如转义序列的后续字节）的最长毫秒数 */
+#define INPUT_WAIT_MS 100
+/** 转义序列的最大长度：超过时整段丢弃 */
+#define INPUT_SEQ_MAX 32
+/** 修饰键：与键码按位或，`KEY_CODE`取出不含修饰键的键码 */
+#define KEY_SHIFT    (1 << 16)
+#define KEY_ALT      (1 << 17)
+#define KEY_CTRL     (1 << 18)
+#define KEY_CODE(k)  ((k) & 0xffff)
+/** 默认最高帧率，可由`$TEXC_FPS`指定，`0`表示不限 */
+#define FRAME_RATE   60
+/** 输入持续到达时一帧至多推迟的毫秒数 */
+#define FRAME_LAG_MS 100
+/** 帧耗时 HUD：统计 p99 时保留的最近帧数 */
+#define HUD_FRAMES 128
+/** 追踪：每个线程环形缓冲区可容纳的事件数（须为 2 的幂） */
+#define TRACE_RING (1 << 18)
+/** 行存储池：块（chunk）的大小，同时也是块地址的对齐值 */
+#define POOL_CHUNK (64 * 1024)
+/** 行存储池：尺寸分级数，参考`pool_class_size` */
+#define POOL_CLASSES 16
+/** 短行内联存储的容量（含结尾`\0`），取此值时行记录恰为 96 字节，参考`erow_t`的`inl` */
+#define ROW_INLINE   33
 
 #define HL_SYN_NUMBERS   (1 << 0)
 #define HL_SYN_STRINGS   (1 << 1)
 
+/** 语法定义：每类定界符的最大个数 */
+#define SYN_TOKENS       4
+/** 语法定义：默认分隔符（另含空白与`\0`） */
+#define SYN_SEPARATORS   ",.()+-/*=~%<>[];"
+
+/** 词法检查点间隔（行） */
+#define HL_CKPT          256
+/** 需要扫描的行数达到此值时分块并行扫描 */
+#define HL_PAR_ROWS      (1 << 16)
+/** 并行扫描的最大线程数 */
+#define HL_THREADS_MAX   16
+/** 高亮缓存：最大项数与哈希桶数（2 的幂） */
+#define HLC_ENTRIES      4096
+#define HLC_BUCKETS      8192
+/** 高亮缓存：所有项的内容副本与区间合计的最大字节数 */
+#define HLC_BYTES        (8 << 20)
+/** 高亮缓存：渲染长度超过此值的行不查询也不缓存 */
+#define HLC_MAX_LEN      4096
+/** 词法状态：低 4 位为种类（参考`editor_hs`），接着 4 位为定界符下标，高 24 位为参数 */
+#define HS_MAKE(kind, idx, arg) ((uint32_t)(kind) | (uint32_t)(idx) << 4 | (uint32_t)(arg) << 8)
+#define HS_KIND(s)       ((s) & 0xf)
+#define HS_IDX(s)        (((s) >> 4) & 0xf)
+#define HS_ARG(s)        ((s) >> 8)
+
 /**
  * @brief 编辑器控制键入配置
  * @note 按键冲突处理
@@ -64,7 +120,12 @@ enum editor_key {
     HOME_KEY    ,
     END_KEY     ,
     PAGE_UP     ,
-    PAGE_DOWN
+    PAGE_DOWN   ,
+    INSERT_KEY  ,
+    F1_KEY      ,               // F1 ~ F12 连续编号
+    F12_KEY = F1_KEY + 11,
+    MOUSE_EVENT ,               // 鼠标事件：详情见`input.mouse`
+    KEY_UNKNOWN                 // 无法识别的转义序列
 };
 
 enum editor_highlight {
@@ -75,7 +136,58 @@ enum editor_highlight {
     HL_MLCOMMENT,
     HL_KEYWORD1 ,
     HL_KEYWORD2 ,
-    HL_MATCH
+    HL_MATCH    ,
+    HL_NUM                      // 类别个数
+};
+
+/**
+ * @brief 行内位置的三种单位
+ */
+enum editor_unit {
+    U_CHARS = 0,    // `c`中的字节偏移，即光标`cursor_x`
+    U_RENDER    ,   // `render`中的字节偏移，高亮区间使用
+    U_COLS          // 屏幕显示列，即`render_x`与`clo_off`
+};
+
+/**
+ * @brief 不规则字符的种类：除此之外的字符都是 1 字节、1 列
+ */
+enum editor_col {
+    COL_TAB = 0,    // 制表符：渲染为若干空格
+    COL_UTF8    ,   // 多字节 UTF-8 字符
+    COL_BAD         // 非法字节或 C1 控制字符：显示为反色`?`
+};
+
+/**
+ * @brief 行标志位，保存在`ebuf_t`的`flags`中
+ */
+enum editor_row_flag {
+    RF_HL_KNOWN = 1 << 0,   // 出口状态是以入口状态扫描本行的结果
+    RF_HL_VALID = 1 << 1    // 高亮区间也是以入口状态计算的
+};
+
+/**
+ * @brief 高亮覆盖层：绘制时按顺序叠加在语法高亮之上，后者优先
+ */
+enum editor_overlay {
+    OV_MATCH = 0,
+    OV_NUM
+};
+
+/**
+ * @brief 一帧内的耗时阶段
+ * @note 任意时刻只有一个阶段在计时，切换阶段时把已过去的时间记到旧阶段上，
+ * 因此嵌套调用（如编辑中触发高亮）得到的是各阶段的独占耗时。
+ * `ST_IDLE`为等待键入的时间，不计入帧耗时。
+ */
+enum editor_stage {
+    ST_IDLE = 0,
+    ST_INPUT    ,
+    ST_EDIT     ,
+    ST_HIGHLIGHT,
+    ST_DRAW     ,
+    ST_WRITE    ,
+    ST_NUM
 };
 
 // ======================================================================= //
@@ -83,100 +195,699 @@ enum editor_highlight {
 // ======================================================================= //
 
 /**
- * @brief 对特定文件类型的语法突出显示信息
+ * @brief 跨行的词法状态种类
+ */
+enum editor_hs {
+    HS_NORMAL = 0,      // 常态
+    HS_BLOCK,           // 多行注释内，参数为嵌套深度
+    HS_MSTRING,         // 多行字符串内，下标为定界符
+    HS_RAW,             // 原始字符串内，参数为填充字符个数
+    HS_HEREDOC,         // here 文档内，参数为结束词的哈希
+};
+
+/**
+ * @brief 字节类别位，参考`esyn_t.cc`
+ */
+enum editor_cc {
+    CC_SEP   = 1 << 0,      // 分隔符
+    CC_DIGIT = 1 << 1,      // 数字
+    CC_QUOTE = 1 << 2,      // 字符串引号
+    CC_LINE  = 1 << 3,      // 某个单行注释以此字节开头
+    CC_BLOCK = 1 << 4,      // 多行注释开始符以此字节开头
+    CC_HEAD  = 1 << 5,      // 某个行首规则以此字节开头
+    CC_MSTR  = 1 << 6,      // 某个多行字符串以此字节开头
+    CC_OPEN  = 1 << 7,      // 原始字符串前缀或 here 文档以此字节开头
+};
+
+/**
+ * @brief 关键词哈希表项
+ */
+typedef struct ekw {
+    /** 关键词，`NULL`表示空槽 */
+    char *s;
+    /** 长度 */
+    int len;
+    /** 高亮类别 */
+    unsigned char cls;
+} ekw_t;
+
+/**
+ * @brief 编译后的语法定义
+ * @note 由语法定义文本经`syn_compile`生成，加载后只读，所有缓冲区共享。
+ * 逐字节的判断都先查`cc`表，只有命中的字节才比较定界符。
  */
 typedef struct esyn {
+    /** 文件类型名 */
     char *filetype;
-    char **filematch;
-    char **keywords;
-    char *singleline_comment_start;
-    char *multiline_comment_start;
-    char *multiline_comment_end;
+    /** 匹配的文件名：以`.`开头为后缀，否则为子串 */
+    char *filematch[SYN_TOKENS * 2];
+    int num_match;
+    /** 字节类别表，参考`editor_cc` */
+    unsigned char cc[256];
+    /** 单行注释开始符 */
+    char *line_comment[SYN_TOKENS];
+    int num_line_comment;
+    /** 多行注释开始符与结束符，`NULL`表示不支持 */
+    char *block_start;
+    char *block_end;
+    /** 布尔：多行注释可以嵌套 */
+    int block_nested;
+    /** 多行字符串的开始符与结束符 */
+    char *mstr_start[SYN_TOKENS];
+    char *mstr_end[SYN_TOKENS];
+    /** 布尔：多行字符串内不处理转义 */
+    unsigned char mstr_raw[SYN_TOKENS];
+    int num_mstr;
+    /** 原始字符串前缀与填充字符，如 Rust 的`r` `#`：`r#"..."#` */
+    char *raw_prefix[SYN_TOKENS];
+    char raw_fill;
+    int num_raw;
+    /** here 文档的开始符，如`<<`，`NULL`表示不支持 */
+    char *heredoc;
+    /** 行首规则：行以`head`开头时整行使用`head_cls` */
+    char *head[SYN_TOKENS];
+    unsigned char head_cls[SYN_TOKENS];
+    int num_head;
+    /** 字符串内的转义字符，`0`表示无 */
+    char escape;
+    /** 关键词哈希表，开放寻址，容量为`kw_mask + 1` */
+    ekw_t *kw;
+    unsigned int kw_mask;
+    /** 标志位：`HL_SYN_NUMBERS`、`HL_SYN_STRINGS` */
     int flags;
 } esyn_t;
-/** C拓展文件后缀 */
-char *C_HL_EXT[] = {".c", ".h", ".cpp", NULL};
-/** C拓展文件关键词 */
-char *C_HL_KEY[] = {
-    "switch", "if", "while", "for", "break", "continue", "return", "else",
-    "struct", "union", "typedef", "static", "enum", "class", "case",
-    "int|", "long|", "double|", "float|", "char|", "unsigned|", "signed|",
-    "void|", NULL
+
+/**
+ * @brief 内置语法定义
+ * @note 与`$TEXC_SYNTAX`目录下的`*.syn`文件格式相同，每行一条指令：
+ * - `name <类型名>`：文件类型名，开始一条新定义
+ * - `match <后缀或文件名>...`：以`.`开头按后缀匹配，否则按子串匹配
+ * - `keyword <词>...` / `type <词>...`：两类关键词
+ * - `comment <开始符>...`：单行注释
+ * - `block <开始符> <结束符> [nested]`：多行注释，可选允许嵌套
+ * - `mstring <开始符> <结束符> [raw]`：跨行字符串，`raw`表示不处理转义
+ * - `rawstring <前缀>... <填充字符>`：原始字符串，如`rawstring r br #`
+ * - `heredoc <开始符>`：here 文档，如`<<EOF`到只含`EOF`的行
+ * - `string <引号字符>...` / `escape <字符>`：字符串与转义字符
+ * - `number`：数字高亮
+ * - `separator <字符>`：额外的分隔符
+ * - `head <开始符> <类别>`：行首规则，类别为`comment`、`keyword1`、
+ *   `keyword2`、`string`或`number`
+ * - 以`#`开头的行为注释（指令参数中的`#`不受影响）
+ */
+const char *SYN_BUILTIN =
+    "name c\n"
+    "match .c .h .cpp\n"
+    "keyword switch if while for break continue return else\n"
+    "keyword struct union typedef static enum class case\n"
+    "type int long double float char unsigned signed void\n"
+    "comment //\n"
+    "block /* */\n"
+    "string \" '\n"
+    "escape \\\n"
+    "number\n"
+    "\n"
+    "name python\n"
+    "match .py\n"
+    "keyword and as assert break class continue def del elif else except\n"
+    "keyword finally for from global if import in is lambda nonlocal not\n"
+    "keyword or pass raise return try while with yield async await\n"
+    "type None True False self int float str bytes list dict set tuple\n"
+    "comment #\n"
+    "mstring \"\"\" \"\"\"\n"
+    "mstring ''' '''\n"
+    "string \" '\n"
+    "escape \\\n"
+    "number\n"
+    "\n"
+    "name rust\n"
+    "match .rs\n"
+    "keyword as break const continue crate else enum extern fn for if impl\n"
+    "keyword in let loop match mod move mut pub ref return static struct\n"
+    "keyword super trait type unsafe use where while async await dyn\n"
+    "type i8 i16 i32 i64 i128 isize u8 u16 u32 u64 u128 usize f32 f64\n"
+    "type bool char str String Self Option Result Vec Box true false\n"
+    "comment //\n"
+    "block /* */ nested\n"
+    "rawstring r br #\n"
+    "string \"\n"
+    "escape \\\n"
+    "number\n"
+    "\n"
+    "name go\n"
+    "match .go\n"
+    "keyword break case chan const continue default defer else fallthrough\n"
+    "keyword for func go goto if import interface map package range return\n"
+    "keyword select struct switch type var\n"
+    "type bool byte error float32 float64 int int8 int16 int32 int64 rune\n"
+    "type string uint uint8 uint16 uint32 uint64 uintptr true false nil iota\n"
+    "comment //\n"
+    "block /* */\n"
+    "mstring ` ` raw\n"
+    "string \" '\n"
+    "escape \\\n"
+    "number\n"
+    "\n"
+    "name sh\n"
+    "match .sh .bash\n"
+    "keyword if then else elif fi case esac for while until do done in\n"
+    "keyword function return local export readonly shift exit\n"
+    "type echo printf read cd test set unset source eval exec trap\n"
+    "comment #\n"
+    "heredoc <<\n"
+    "string \" '\n"
+    "escape \\\n"
+    "number\n"
+    "\n"
+    "name json\n"
+    "match .json\n"
+    "type true false null\n"
+    "string \"\n"
+    "escape \\\n"
+    "separator : { } ,\n"
+    "number\n"
+    "\n"
+    "name markdown\n"
+    "match .md .markdown\n"
+    "head # keyword1\n"
+    "head > comment\n"
+    "head - keyword2\n"
+    "head * keyword2\n"
+    "block ``` ```\n"
+    "string `\n";
+
+/** 语法突出数据库：内置定义与用户定义编译后的结果 */
+esyn_t *HLDB = NULL;
+/** 语法突出数据库大小 */
+int HLDB_ENTRIES = 0;
+
+/**
+ * @brief 行存储池中的块
+ * @note 块按`POOL_CHUNK`对齐，块内任意地址清零低位即得块头。
+ * 小块按同一尺寸分级切分，大于最大分级的分配独占一个大块。
+ */
+typedef struct pchunk {
+    /** 池内双向链表 */
+    struct pchunk *prev, *next;
+    /** 尺寸分级，`-1`表示大块 */
+    int cls;
+    /** 小块：已切分到的偏移；大块：可用容量 */
+    size_t used;
+} pchunk_t;
+
+/**
+ * @brief 行存储池：为行的`c`、`render`、`hl`分配内存
+ * @note 分级分配减少碎片；关闭文件时整体释放所有块，无需逐行释放。
+ */
+typedef struct epool {
+    /** 全部块 */
+    pchunk_t *chunks;
+    /** 各分级正在切分的块 */
+    pchunk_t *cur[POOL_CLASSES];
+    /** 各分级的空闲链表 */
+    void *free[POOL_CLASSES];
+} epool_t;
+
+/**
+ * @brief 高亮区间：从渲染位置`start`起连续`len`字节属于同一高亮类别
+ */
+typedef struct hlspan {
+    /** 起始渲染位置 */
+    int start;
+    /** 长度 */
+    int len;
+    /** 高亮类别，参考`editor_highlight` */
+    int cls;
+} hlspan_t;
+
+/**
+ * @brief 高亮缓存项：一行渲染内容在某入口状态下的高亮结果
+ * @note 命中时区间被复制到行里，行不持有缓存项；`refs`计入缓存自身与正在复制它的查询，
+ * 被淘汰的项在最后一个查询释放引用时才真正释放。
+ */
+typedef struct ehlc_entry {
+    /** 键：渲染内容的哈希、内容副本、入口状态与语法定义 */
+    uint64_t hash;
+    char *render;
+    int rlen;
+    uint32_t in;
+    const struct esyn *syntax;
+    /** 值：出口状态与高亮区间 */
+    uint32_t out;
+    hlspan_t *hl;
+    int num_hl;
+    /** 引用计数 */
+    int refs;
+    /** LRU 链表，表头为最近使用 */
+    struct ehlc_entry *prev, *next;
+    /** 哈希桶链 */
+    struct ehlc_entry *chain;
+} ehlc_entry_t;
+
+/**
+ * @brief 高亮缓存：有界 LRU，所有缓冲区共享
+ */
+typedef struct ehlc {
+    ehlc_entry_t *bucket[HLC_BUCKETS];
+    ehlc_entry_t *head, *tail;
+    int count;
+    /** 所有项的内容副本与区间合计的字节数 */
+    size_t bytes;
+    /** 累计查询与命中次数 */
+    uint64_t lookups, hits;
+    pthread_mutex_t lock;
+} ehlc_t;
+
+/**
+ * @brief 高亮覆盖层中的一段
+ */
+typedef struct eoverlay {
+    /** 所在文件行，`-1`表示未启用 */
+    int row;
+    /** 起始渲染位置 */
+    int start;
+    /** 长度 */
+    int len;
+    /** 高亮类别 */
+    int cls;
+} eoverlay_t;
+
+/** 东亚宽字符与零宽字符区间表，按码点升序 */
+const struct {
+    uint32_t lo, hi;
+    unsigned char w;
+} WIDTH_TABLE[] = {
+    {0x0300, 0x036F, 0}, {0x0483, 0x0489, 0}, {0x0591, 0x05BD, 0},
+    {0x0610, 0x061A, 0}, {0x064B, 0x065F, 0}, {0x1100, 0x115F, 2},
+    {0x1AB0, 0x1AFF, 0}, {0x1DC0, 0x1DFF, 0}, {0x200B, 0x200F, 0},
+    {0x20D0, 0x20FF, 0}, {0x231A, 0x231B, 2}, {0x2329, 0x232A, 2},
+    {0x23E9, 0x23EC, 2}, {0x25FD, 0x25FE, 2}, {0x2614, 0x2615, 2},
+    {0x2E80, 0x303E, 2}, {0x3041, 0x33FF, 2}, {0x3400, 0x4DBF, 2},
+    {0x4E00, 0x9FFF, 2}, {0xA000, 0xA4CF, 2}, {0xA960, 0xA97F, 2},
+    {0xAC00, 0xD7A3, 2}, {0xF900, 0xFAFF, 2}, {0xFE00, 0xFE0F, 0},
+    {0xFE10, 0xFE19, 2}, {0xFE20, 0xFE2F, 0}, {0xFE30, 0xFE6F, 2},
+    {0xFF00, 0xFF60, 2}, {0xFFE0, 0xFFE6, 2}, {0x16FE0, 0x16FE4, 2},
+    {0x17000, 0x18CFF, 2}, {0x1B000, 0x1B2FF, 2}, {0x1F300, 0x1F64F, 2},
+    {0x1F680, 0x1F6FF, 2}, {0x1F900, 0x1F9FF, 2}, {0x1FA70, 0x1FAFF, 2},
+    {0x20000, 0x2FFFD, 2}, {0x30000, 0x3FFFD, 2}, {0xE0100, 0xE01EF, 0},
+};
+/** 宽度表大小 */
+#define WIDTH_ENTRIES (sizeof(WIDTH_TABLE) / sizeof(WIDTH_TABLE[0]))
+
+/**
+ * @brief 终端的颜色深度，参考`theme_detect`
+ */
+enum editor_depth {
+    CD_16 = 0,      // 16 色：`CSI 3x m`
+    CD_256,         // 256 色：`CSI 38;5;n m`
+    CD_TRUE         // 真彩色：`CSI 38;2;r;g;b m`
 };
-/** 语法突出数据库 */
-esyn_t HLDB[] = {
-    {
-        "c", 
-        C_HL_EXT, C_HL_KEY, 
-        "//", "/*", "*/",
-        HL_SYN_NUMBERS | HL_SYN_STRINGS
-    },
+
+/**
+ * @brief 内置主题：按`editor_highlight`顺序给出各高亮类别的前景色
+ * @note `ansi`为 16 色下的 SGR 参数；`rgb`为`0xRRGGBB`，
+ * `-1`表示在任何颜色深度下都使用`ansi`，即沿用终端自己的调色板。
+ */
+const struct {
+    const char *name;
+    int ansi[HL_NUM];
+    int rgb[HL_NUM];
+} THEMES[] = {
+    { "default",
+      { 39, 33, 31, 32, 32, 35, 36, 34 },
+      { -1, -1, -1, -1, -1, -1, -1, -1 } },
+    { "gruvbox",
+      { 39, 32, 35, 90, 90, 31, 33, 34 },
+      { -1, 0xb8bb26, 0xd3869b, 0x928374, 0x928374, 0xfb4934, 0xfabd2f, 0x83a598 } },
+    { "solarized",
+      { 39, 36, 35, 90, 90, 32, 33, 34 },
+      { -1, 0x2aa198, 0xd33682, 0x586e75, 0x586e75, 0x859900, 0xb58900, 0x268bd2 } },
 };
-/** 语法突出数据库大小 */
-#define HLDB_ENTRIES (sizeof(HLDB) / sizeof(HLDB[0]))
+/** 内置主题个数 */
+#define THEME_ENTRIES (sizeof(THEMES) / sizeof(THEMES[0]))
+
+/**
+ * @brief 编译后的主题：各高亮类别预先编码好的 SGR 序列
+ * @note 绘制时直接追加`sgr[cls]`，不再逐段格式化。
+ * 颜色相同的类别记为其中最小的类别（`alias`），相邻时不重复输出。
+ */
+typedef struct etheme {
+    /** 主题名 */
+    const char *name;
+    /** 颜色深度，参考`editor_depth` */
+    int depth;
+    /** SGR 序列与长度 */
+    char sgr[HL_NUM][24];
+    unsigned char len[HL_NUM];
+    /** 颜色相同的最小类别 */
+    unsigned char alias[HL_NUM];
+} etheme_t;
+
+/**
+ * @brief 列索引项：记录一个不规则字符在三种单位下的起始位置与长度
+ * @note 相邻两项之间的字符都是 1 字节、1 列，
+ * 因此任意单位间的换算只需二分查找前一项再做加减。
+ */
+typedef struct ecol {
+    /** 字符索引：`c`中的字节偏移 */
+    int cx;
+    /** `render`中的字节偏移 */
+    int bx;
+    /** 起始显示列 */
+    int rx;
+    /** 种类，参考`editor_col` */
+    unsigned char kind;
+    /** 在`c`中占用的字节数 */
+    unsigned char n;
+    /** 显示宽度 */
+    unsigned char w;
+} ecol_t;
+
+/**
+ * @brief 驻留文本：内容相同的未修改行共享的只读文本块
+ * @note 同时持有由内容决定的`render`与列索引，因此共享的行无需各自展开。
+ * 块与其`render`、`cols`都分配自缓冲区的`pool`，最后一行释放引用时归还。
+ */
+typedef struct etext {
+    /** 内容哈希 */
+    uint64_t hash;
+    /** 引用它的行数 */
+    int refs;
+    /** 哈希桶链 */
+    struct etext *chain;
+    /** 渲染内容、长度与是否共用`c`的存储 */
+    char *render;
+    int rlen;
+    int render_alias;
+    /** 列索引与项数 */
+    ecol_t *cols;
+    int num_cols;
+    /** 文本长度与内容（以`\0`结尾） */
+    int len;
+    char c[];
+} etext_t;
 
 /**
  * @brief 编辑器行
- * @note 将一行文本存储为指向动态分配的字符数据的指针和其长度
+ * @note 将一行文本存储为指向动态分配的字符数据的指针和其长度，
+ * 内存来自所属缓冲区的`pool`。
+ * - 长度小于`ROW_INLINE`的行把`c`直接存放在行记录的`inl`中，放得下时`render`紧随其后，
+ *   行记录移动后须调用`editor_row_rebase`修正指针；
+ * - 不含制表符的行`render`与`c`逐字节相同，直接共用`c`的存储；
+ * - 高亮按区间保存，只记录非`HL_NORMAL`的区间，区间之间的空隙为普通文本；
+ * - 长度、词法状态等整文件扫描用到的元数据另存在缓冲区的结构数组中，参考`ebuf_t`。
  */
 typedef struct erow {
+    /** 指向需要渲染的字符串 */
+    char *render;
+    /** 短行的内联存储，紧跟`render`使查找只读取行记录开头的一小段 */
+    char inl[ROW_INLINE];
+    /** 布尔：`render`是否共用`c`的存储 */
+    unsigned char render_alias;
+    /** 布尔：`c`存放在`inl`中；`render`存放在`inl`中（位于`c`的结尾之后） */
+    unsigned char inl_c, inl_r;
     /** 文件中自己的索引 */
     int idx;
-    /** 动态分配的字符数据的字符串指针 */
-    char *c;
     /** 字符串长度 */
     int len;
-    /** 指向需要渲染的字符串 */
-    char *render;
     /** 渲染内容长度 */
     int rlen;
-    /** 语法高亮 */
-    unsigned char *hl;
-    /** 布尔：高亮是否未闭合 */
-    int hl_open_comment;
+    /** 列索引项数，纯 ASCII 且无制表符的行为`0` */
+    int num_cols;
+    /** 高亮区间数，`0`表示整行为`HL_NORMAL` */
+    int num_hl;
+    /** 动态分配的字符数据的字符串指针 */
+    char *c;
+    /** 非空时`c`、`render`与`cols`借用自该驻留文本，只读，修改前须先复制 */
+    etext_t *text;
+    /** 不规则字符的列索引，按位置升序，随`render`一起更新 */
+    ecol_t *cols;
+    /** 语法高亮区间，按起始位置升序 */
+    hlspan_t *hl;
 } erow_t;
 
-
+/**
+ * @brief 编辑器缓冲区：一个打开的文件及其全部行
+ * @note 行、语法与文件读写函数都显式接收缓冲区，不访问全局的`ec`，
+ * 因此不同线程可以各自处理自己的缓冲区。
+ */
+typedef struct ebuf {
+    /** 编辑器行 */
+    erow_t *row;
+    /** 总行数 */
+    int num_rows;
+    /** `row`数组的容量，也是以下各行元数据数组的容量 */
+    int row_cap;
+    /** 各行长度与渲染长度：`row[i].len`与`row[i].rlen`的副本，由`editor_update_row`同步 */
+    int *lens, *rlens;
+    /** 各行词法状态：行首（入口）与行尾（出口），参考`HS_MAKE` */
+    uint32_t *hs_in, *hs_out;
+    /** 各行标志位，参考`editor_row_flag` */
+    unsigned char *flags;
+    /** 各行的行戳：行内容或高亮区间改变时取新值，参考`editor_row_stamp` */
+    uint32_t *stamps;
+    /** 脏读标志 */
+    int dirty;
+    /** 文件名 */
+    char *filename;
+    /** 语法突出信息 */
+    esyn_t *syntax;
+    /** 行存储池 */
+    epool_t pool;
+    /** 内容版本：行内容或高亮失效时递增，绘制时据此判断窗口能否沿用屏幕上的内容 */
+    unsigned int version;
+    /** 切换离开时保存的视图状态：光标与偏移量 */
+    int cursor_x, cursor_y, row_off, clo_off;
+    /** 词法检查点：`ckpt[k]`为第`k * HL_CKPT`行的入口状态 */
+    uint32_t *ckpt;
+    /** 有效检查点个数，至少为`1`（第`0`行入口恒为`HS_NORMAL`） */
+    int num_ckpt;
+    /** 布尔：新行是否驻留，由环境变量`TEXC_INTERN`开启 */
+    int intern;
+    /** 驻留文本哈希表：桶数组、桶数（2 的幂）与文本块数 */
+    etext_t **texts;
+    int texts_cap;
+    int num_texts;
+} ebuf_t;
 
 /**
- * @brief 编辑器配置结构体，保存了编辑器的信息。
+ * @brief 窗口：缓冲区上的一个视图
+ * @note 多个窗口可以指向同一个缓冲区，共享行、渲染结果与高亮区间，
+ * 各自只保存光标、滚动偏移与屏幕区域。
  */
-typedef struct editor_config {
-    /** 屏幕行数 */
-    int screen_rows;
-    /** 屏幕列数 */
-    int screen_cols;
+typedef struct ewin {
+    /** 显示的缓冲区 */
+    ebuf_t *buf;
     /** 光标 x 轴坐标 */
     int cursor_x;
     /** 光标 y 轴坐标 */
     int cursor_y;
     /** 渲染 x 轴坐标 */
     int render_x;
-    /** 渲染 y 轴坐标 */
-    int render_y;
-    /** 编辑器总行数 */
-    int num_rows;
-    /** 编辑器行偏移量 */
+    /** 行偏移量 */
     int row_off;
-    /** 编辑器列偏移量 */
+    /** 列偏移量 */
     int clo_off;
-    /** 脏读标志 */
-    int dirty;
-    /** 编辑器行 */
-    erow_t *row;
-    /** 文件名 */
-    char *filename;
+    /** 屏幕区域：左上角（从`0`开始）与文本区行列数，不含状态栏 */
+    int top, left, rows, cols;
+    /** 上一帧绘制时的状态：布尔`drawn`表示屏幕上的文本区有效 */
+    int drawn;
+    ebuf_t *drawn_buf;
+    unsigned int drawn_version;
+    int drawn_row_off, drawn_clo_off;
+    int drawn_top, drawn_left, drawn_rows, drawn_cols;
+    /** 上一帧状态栏输出的哈希 */
+    uint64_t drawn_status;
+    /** 渲染行缓存：槽数（2 的幂），参考`editor_line_get` */
+    struct eline *lines;
+    int num_lines;
+} ewin_t;
+
+/**
+ * @brief 分割方式
+ */
+enum editor_split {
+    SPLIT_NONE = 0,     // 叶子：一个窗口
+    SPLIT_H,            // 上下分割
+    SPLIT_V,            // 左右分割
+};
+
+/**
+ * @brief 窗口布局树节点
+ */
+typedef struct esplit {
+    /** 分割方式，参考`editor_split` */
+    int dir;
+    /** 叶子节点的窗口 */
+    ewin_t *win;
+    /** 子节点：上/左与下/右 */
+    struct esplit *a, *b;
+    /** 父节点 */
+    struct esplit *parent;
+    /** 屏幕区域：左上角与行列数，含状态栏 */
+    int top, left, rows, cols;
+} esplit_t;
+
+/**
+ * @brief 编辑器配置结构体，保存了编辑器的信息。
+ */
+typedef struct editor_config {
+    /** 屏幕行数 */
+    int screen_rows;
+    /** 屏幕列数 */
+    int screen_cols;
+    /** 当前窗口 */
+    ewin_t *win;
+    /** 窗口布局树 */
+    esplit_t *layout;
+    /** 全部窗口，按布局树的先序排列 */
+    ewin_t **wins;
+    /** 窗口个数 */
+    int num_wins;
+    /** 已打开的缓冲区列表 */
+    ebuf_t **bufs;
+    /** 缓冲区个数 */
+    int num_bufs;
     /** 状态栏信息 */
     char status_msg[80];
     /** 状态栏信息：时间 */
     time_t status_msg_time;
-    /** 语法突出信息 */
-    esyn_t *syntax;
+    /** 高亮覆盖层，参考`editor_overlay` */
+    eoverlay_t overlay[OV_NUM];
+    /** 当前主题 */
+    etheme_t theme;
+    /** 最短帧间隔（纳秒），`0`表示不限帧率 */
+    uint64_t frame_ns;
+    /** 布尔：下一帧整屏重绘 */
+    int redraw;
+    /** 上一帧绘制时的覆盖层与当前缓冲区：改变时所有窗口重绘 */
+    eoverlay_t drawn_overlay[OV_NUM];
+    ebuf_t *drawn_focus;
+    /** 上一帧消息栏输出的哈希 */
+    uint64_t drawn_msg;
+    /** 布尔：是否开启了鼠标报告，设置环境变量`TEXC_MOUSE`开启 */
+    int mouse;
     /** 系统终端属性 */
     struct termios orig_termios; 
 } editor_config_t;
 editor_config_t ec;     /** 全局编辑器配置实例 */
 
+/**
+ * @brief 单帧耗时统计
+ */
+typedef struct eframe {
+    /** 各阶段耗时（纳秒），参考`editor_stage` */
+    uint64_t ns[ST_NUM];
+    /** 写出到终端的字节数 */
+    int bytes;
+    /** 本帧处理的按键数 */
+    int keys;
+    /** 终端积压而丢弃的帧数 */
+    int drops;
+    /** 重新高亮的行数 */
+    int hl_rows;
+    /** 命中高亮缓存的行数 */
+    int hl_hits;
+} eframe_t;
+
+/**
+ * @brief 帧耗时 HUD
+ * @note 按`Ctrl-T`切换，开启后状态栏左侧显示上一帧各阶段耗时。
+ */
+typedef struct ehud {
+    /** 布尔：是否显示 */
+    int on;
+    /** 当前计时阶段 */
+    int stage;
+    /** 当前阶段开始时间 */
+    uint64_t stamp;
+    /** 正在统计的帧 */
+    eframe_t cur;
+    /** 上一帧 */
+    eframe_t last;
+    /** 最近`HUD_FRAMES`帧的总耗时（环形） */
+    uint64_t total[HUD_FRAMES];
+    /** 已完成的帧数 */
+    unsigned int frames;
+} ehud_t;
+ehud_t hud;             /** 全局帧耗时统计 */
+uint32_t row_stamp;     /** 最近分配的行戳，原子递增，参考`editor_row_stamp` */
+ehlc_t hlc = { .lock = PTHREAD_MUTEX_INITIALIZER };     /** 全局高亮缓存 */
+__thread int hud_owner; /** 布尔：当前线程负责帧统计（仅主线程） */
+
+/**
+ * @brief 追踪事件
+ */
+typedef struct etrace_ev {
+    /** 事件名：须为静态字符串 */
+    const char *name;
+    /** 时间戳（纳秒） */
+    uint64_t ts;
+    /** 阶段：`B`开始，`E`结束 */
+    char ph;
+} etrace_ev_t;
+
+/**
+ * @brief 线程私有的追踪环形缓冲区
+ * @note 只有所属线程写入`ev`与`head`，写满后覆盖最旧的事件，
+ * 因此记录时无需加锁；导出时按`head`读取最近`TRACE_RING`个事件。
+ * 线程退出时归还缓冲区，之后新建的线程（如高亮工作线程）接着使用，
+ * 它们的事件在导出结果中共用同一个线程编号。
+ */
+typedef struct etrace_ring {
+    /** 全局链表中的下一个缓冲区 */
+    struct etrace_ring *next;
+    /** 线程编号 */
+    int tid;
+    /** 布尔：正被某个线程使用，通过 CAS 认领 */
+    int busy;
+    /** 已写入的事件总数 */
+    uint64_t head;
+    /** 事件数组 */
+    etrace_ev_t ev[TRACE_RING];
+} etrace_ring_t;
+
+/**
+ * @brief 追踪器：设置环境变量`TEXC_TRACE=<file>`开启，
+ * 退出时导出 Chrome trace JSON，可直接用 Perfetto 打开。
+ */
+typedef struct etrace {
+    /** 输出文件，`NULL`表示未开启 */
+    char *path;
+    /** 所有线程的缓冲区链表 */
+    etrace_ring_t *rings;
+    /** 已分配的线程编号 */
+    int tids;
+    /** 起始时间 */
+    uint64_t t0;
+} etrace_t;
+etrace_t trace;         /** 全局追踪器 */
+
+/**
+ * @brief 鼠标事件（SGR 格式）
+ */
+typedef struct emouse {
+    /** 按键：`0`左、`1`中、`2`右；加`32`表示拖动，加`64`表示滚轮（`64`上、`65`下） */
+    int button;
+    /** 屏幕坐标，从`0`开始 */
+    int x, y;
+    /** 布尔：按下（`M`）或释放（`m`） */
+    int press;
+} emouse_t;
+
+/**
+ * @brief 输入环形缓冲区：一次`read`读入终端已有的全部字节，再逐个解码
+ * @note `head`与`tail`是累计字节数，取模`INPUT_RING`得到下标。
+ */
+typedef struct einput {
+    unsigned char buf[INPUT_RING];
+    /** 已读入与已解码的字节数 */
+    unsigned int head, tail;
+    /** 最近一次鼠标事件 */
+    emouse_t mouse;
+} einput_t;
+einput_t input;         /** 全局输入缓冲区 */
+
 /**
  * @brief 追加缓冲区结构体
  */
@@ -185,23 +896,32 @@ typedef struct abuf {
     char *b;
     /** 字符串长度 */
     int len;
+    /** 已分配的容量 */
+    int cap;
 } abuf_t;
 
 /** 追加缓冲区初始化 */
-#define ABUF_INIT {NULL, 0}
+#define ABUF_INIT {NULL, 0, 0}
 
 /**
  * @brief 缓冲区追加字符串
  * @param ab 追加缓冲区
  * @param s 字符串
  * @param len 字符串长度
+ * @note 容量按倍数增长：绘制一帧要追加成千上万个小片段，不能每次都`realloc`；
+ * 同理声明为内联，省去每个片段的函数调用。
  */
-void abuf_append(abuf_t *ab, const char *s, int len) {
-    char *new = realloc(ab->b, ab->len + len);
-    if(new == NULL)
-        return;
-    memcpy(&new[ab->len], s, len);      // 新值复制
-    ab->b = new;
+static inline void abuf_append(abuf_t *ab, const char *s, int len) {
+    if (ab->len + len > ab->cap) {
+        int cap = ab->cap ? ab->cap * 2 : 256;
+        while (cap < ab->len + len) cap *= 2;
+        char *new = realloc(ab->b, cap);
+        if(new == NULL)
+            return;
+        ab->b = new;
+        ab->cap = cap;
+    }
+    memcpy(&ab->b[ab->len], s, len);    // 新值复制
     ab->len += len;
 }
 
@@ -213,6 +933,33 @@ void abuf_free(abuf_t *ab) {
     free(ab->b);
 }
 
+/**
+ * @brief 渲染行缓存项：一行编码好的终端字节，参考`editor_line_get`
+ */
+typedef struct eline {
+    /** 编码时的行戳，`0`表示空槽 */
+    uint32_t stamp;
+    /** 编码时窗口的列偏移与宽度 */
+    int clo_off, cols;
+    /** 编码结果 */
+    abuf_t ab;
+} eline_t;
+
+/**
+ * @brief 输出缓冲区：终端来不及接收时暂存尚未写出的帧
+ */
+typedef struct eoutput {
+    /** 待写出的帧 */
+    abuf_t ab;
+    /** 已写出的字节数 */
+    int off;
+    /** 布尔：有帧因终端积压被丢弃，屏幕落后于编辑器状态 */
+    int stale;
+    /** 进入编辑器前标准输出的文件状态标志 */
+    int flags;
+} eoutput_t;
+eoutput_t output;       /** 全局输出缓冲区 */
+
 
 // ======================================================================= //
 //                            Func Prototypes
@@ -230,6 +977,20 @@ void editor_set_status_msg(const char *fmt, ...);
  */
 void editor_refresh_screen();
 
+/**
+ * @brief 尽量写出输出缓冲区中积压的帧
+ * @param block 布尔：终端暂时写不进时是否等待直到写完
+ * @return int 布尔：是否已全部写出
+ */
+int output_flush(int block);
+
+/**
+ * @brief 给一行分配新的行戳，使其渲染行缓存失效
+ * @param b 缓冲区
+ * @param i 行号
+ */
+void editor_row_stamp(ebuf_t *b, int i);
+
 /**
  * @brief 编辑器显示提示，提供文本输入
  * @param prompt 提示信息
@@ -238,6 +999,214 @@ void editor_refresh_screen();
  */
 char *editor_prompt(char *prompt, void (*callback)(char *, int));
 
+// ======================================================================= //
+//                              Frame Timing
+// ======================================================================= //
+
+/**
+ * @brief 读取单调时钟
+ * @return uint64_t 纳秒
+ */
+uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/**
+ * @brief 切换计时阶段
+ * @param stage 新阶段，参考`editor_stage`
+ * @return int 原阶段，用于之后恢复
+ */
+int hud_enter(int stage) {
+    if (!hud_owner) return hud.stage;
+    uint64_t now = now_ns();
+    int prev = hud.stage;
+    hud.cur.ns[prev] += now - hud.stamp;
+    hud.stamp = now;
+    hud.stage = stage;
+    return prev;
+}
+
+/**
+ * @brief 结束一帧：保存为上一帧并计入 p99 窗口
+ * @param bytes 本帧写出字节数
+ */
+void hud_commit(int bytes) {
+    hud_enter(ST_EDIT);
+    hud.cur.bytes = bytes;
+    uint64_t total = 0;
+    for (int i = ST_INPUT; i < ST_NUM; i++)
+        total += hud.cur.ns[i];
+    hud.total[hud.frames++ % HUD_FRAMES] = total;
+    hud.last = hud.cur;
+    memset(&hud.cur, 0, sizeof(hud.cur));
+}
+
+/** `qsort`比较函数 */
+int hud_cmp(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief 最近帧总耗时的 p99
+ * @return uint64_t 纳秒
+ */
+uint64_t hud_p99() {
+    uint64_t v[HUD_FRAMES];
+    int n = hud.frames < HUD_FRAMES ? hud.frames : HUD_FRAMES;
+    if (n == 0) return 0;
+    memcpy(v, hud.total, n * sizeof(v[0]));
+    qsort(v, n, sizeof(v[0]), hud_cmp);
+    return v[(n * 99) / 100];
+}
+
+/**
+ * @brief 格式化 HUD 文本
+ * @param buf 输出缓冲区
+ * @param size 缓冲区大小
+ * @return int 文本长度
+ */
+int hud_format(char *buf, int size) {
+    eframe_t *f = &hud.last;
+    int len = snprintf(buf, size,
+        "in %lluus/%dk ed %lluus hl %lluus/%dr+%dc(%d%%) dr %lluus wr %lluus %dB/%dd p99 %lluus",
+        (unsigned long long)f->ns[ST_INPUT] / 1000, f->keys,
+        (unsigned long long)f->ns[ST_EDIT] / 1000,
+        (unsigned long long)f->ns[ST_HIGHLIGHT] / 1000, f->hl_rows, f->hl_hits,
+        hlc.lookups ? (int)(hlc.hits * 100 / hlc.lookups) : 0,
+        (unsigned long long)f->ns[ST_DRAW] / 1000,
+        (unsigned long long)f->ns[ST_WRITE] / 1000, f->bytes, f->drops,
+        (unsigned long long)hud_p99() / 1000);
+    return len < size ? len : size - 1;
+}
+
+// ======================================================================= //
+//                                Tracing
+// ======================================================================= //
+
+/** 当前线程的追踪缓冲区 */
+static __thread etrace_ring_t *trace_ring;
+/** 线程退出时调用`trace_release`归还缓冲区 */
+static pthread_key_t trace_key;
+
+/**
+ * @brief 归还线程退出时仍持有的追踪缓冲区
+ * @param p 缓冲区
+ */
+void trace_release(void *p) {
+    etrace_ring_t *r = p;
+    __atomic_store_n(&r->busy, 0, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief 为当前线程取得追踪缓冲区：先认领已退出线程归还的，没有时再分配
+ * @return etrace_ring_t* 缓冲区，内存不足时为`NULL`
+ */
+etrace_ring_t *trace_claim() {
+    etrace_ring_t *r;
+    for (r = __atomic_load_n(&trace.rings, __ATOMIC_ACQUIRE); r; r = r->next) {
+        int idle = 0;
+        if (__atomic_compare_exchange_n(&r->busy, &idle, 1, 0,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            return r;
+    }
+    // 全部在用：分配新缓冲区并无锁挂入全局链表
+    r = calloc(1, sizeof(etrace_ring_t));
+    if (r == NULL) return NULL;
+    r->busy = 1;
+    r->tid = __atomic_add_fetch(&trace.tids, 1, __ATOMIC_RELAXED);
+    r->next = __atomic_load_n(&trace.rings, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&trace.rings, &r->next, r, 1,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    return r;
+}
+
+/**
+ * @brief 记录追踪事件
+ * @param name 事件名
+ * @param ph 阶段：`B`开始，`E`结束
+ */
+void trace_event(const char *name, char ph) {
+    if (trace.path == NULL) return;
+    etrace_ring_t *r = trace_ring;
+    if (r == NULL) {
+        // 首次记录：取得缓冲区，并登记线程退出时归还
+        r = trace_claim();
+        if (r == NULL) return;
+        pthread_setspecific(trace_key, r);
+        trace_ring = r;
+    }
+    etrace_ev_t *e = &r->ev[r->head & (TRACE_RING - 1)];
+    e->name = name;
+    e->ts = now_ns();
+    e->ph = ph;
+    __atomic_store_n(&r->head, r->head + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief 开始一个追踪区间
+ * @param name 事件名
+ * @return const char* 事件名，交给`trace_scope_end`
+ */
+const char *trace_begin(const char *name) {
+    trace_event(name, 'B');
+    return name;
+}
+
+/**
+ * @brief 结束追踪区间：由`cleanup`属性在离开作用域时调用
+ * @param name 指向事件名的指针
+ */
+void trace_scope_end(const char **name) {
+    trace_event(*name, 'E');
+}
+
+/** 在当前作用域记录一对开始/结束事件 */
+#define TRACE_SCOPE(name) \
+    const char *trace_scope_ __attribute__((cleanup(trace_scope_end))) = trace_begin(name)
+
+/**
+ * @brief 导出 Chrome trace JSON：退出时调用
+ */
+void trace_dump() {
+    FILE *fp = fopen(trace.path, "w");
+    if (!fp) return;
+    int pid = getpid();
+    int first = 1;
+    fprintf(fp, "{\"traceEvents\":[\n");
+    etrace_ring_t *r;
+    for (r = __atomic_load_n(&trace.rings, __ATOMIC_ACQUIRE); r; r = r->next) {
+        uint64_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+        uint64_t i = head > TRACE_RING ? head - TRACE_RING : 0;
+        for (; i < head; i++) {
+            etrace_ev_t *e = &r->ev[i & (TRACE_RING - 1)];
+            uint64_t ts = e->ts - trace.t0;
+            fprintf(fp, "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%llu.%03u,"
+                        "\"pid\":%d,\"tid\":%d}",
+                    first ? "" : ",\n", e->name, e->ph,
+                    (unsigned long long)(ts / 1000), (unsigned)(ts % 1000),
+                    pid, r->tid);
+            first = 0;
+        }
+    }
+    fprintf(fp, "\n]}\n");
+    fclose(fp);
+}
+
+/**
+ * @brief 追踪初始化：读取环境变量`TEXC_TRACE`
+ */
+void trace_init() {
+    char *path = getenv("TEXC_TRACE");
+    if (path == NULL || path[0] == '\0') return;
+    if (pthread_key_create(&trace_key, trace_release) != 0) return;
+    trace.path = strdup(path);
+    trace.t0 = now_ns();
+    atexit(trace_dump);
+}
+
 // ======================================================================= //
 //                               Terminal
 // ======================================================================= //
@@ -247,6 +1216,7 @@ char *editor_prompt(char *prompt, void (*callback)(char *, int));
  * @param s 错误信息
  */
 void fatal(const char *s) {
+    output_flush(1);
     write(STDOUT_FILENO, "\x1b[2J", 4);
     write(STDOUT_FILENO, "\x1b[H" , 3);
     perror(s);
@@ -257,6 +1227,9 @@ void fatal(const char *s) {
  * @brief 关闭原始文本模式：参考`enable_raw_mode`
  */
 void disable_raw_mode() {
+    output_flush(1);
+    fcntl(STDOUT_FILENO, F_SETFL, output.flags);
+    if (ec.mouse) write(STDOUT_FILENO, "\x1b[?1006l\x1b[?1000l", 16);  // 关闭鼠标报告
     if(tcsetattr(STDIN_FILENO, TCIFLUSH, &ec.orig_termios) == -1)
         fatal("tcsetattr");
 }
@@ -304,6 +1277,14 @@ void disable_raw_mode() {
  * 它以十分之一秒为单位，因此我们将其设置为`1/10`秒，即`100`毫秒。
  * 如果`read()`超时，它将返回`0`。这是有道理的，
  * 因为它通常的返回值是读取的字节数。
+ *
+ * ## 鼠标
+ * 设置了环境变量`TEXC_MOUSE`时开启按键报告（`?1000`）并使用 SGR 编码（`?1006`），
+ * 参考`editor_decode_csi`。开启后终端自身的选择与复制粘贴不再可用，因此默认关闭。
+ *
+ * ## 非阻塞输出
+ * 这里只记下标准输出原来的文件状态标志，`editor_init`取得窗口大小后再设置`O_NONBLOCK`，
+ * 参考`output_flush`。此后读终端也不再阻塞，等待输入改由`term_poll`完成。
  */
 void enable_raw_mode() {
     if(tcgetattr(STDIN_FILENO, &ec.orig_termios) == -1)            // 读取到`termios`结构体
@@ -318,78 +1299,292 @@ void enable_raw_mode() {
     raw.c_cc[VTIME] = 1;        
     if(tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw) == -1)          // 将修改后的结构体传回新的终端属性
         fatal("tcsetattr");
+    output.flags = fcntl(STDOUT_FILENO, F_GETFL);
+    ec.mouse = getenv("TEXC_MOUSE") != NULL;
+    if (ec.mouse) write(STDOUT_FILENO, "\x1b[?1000h\x1b[?1006h", 16);  // 开启鼠标报告
 }
 
 /**
- * @brief 编辑器读取键入
- * @return char 键入字符
- * @note Arrow 转义字符处理
- * - 如果我们读取一个转义字符，会立即将另外两个字节读入`seq`缓冲区。
- * 如果其中任何一个读数超时（0.1 秒后），
- * 则假设用户只是按下了 Escape 键并返回该键。
- * 否则，会查看转义序列是否为箭头键转义序列。
+ * @brief 尽量写出输出缓冲区中积压的帧
+ * @param block 布尔：终端暂时写不进时是否等待直到写完
+ * @return int 布尔：是否已全部写出
+ * @note 标准输出是非阻塞的：终端来不及接收时只写出一部分，
+ * 剩余部分在`term_poll`等到终端可写时继续写出，编辑器不会因此阻塞在`write`上。
+ * 写出出错时丢弃剩余部分；各窗口记录的屏幕状态已按整帧更新，因此下一帧整屏重绘。
  */
-int editor_read_key() {
-    int nread;
-    char c;
-    while((nread = read(STDIN_FILENO, &c, 1)) != 1) {
-        if(nread == -1 && errno != EAGAIN)
-            fatal("read");
-    }
-    if(c == '\x1b') {        // 键入为转义字符时
-        char seq[3];
-        if (read(STDIN_FILENO, &seq[0], 1) != 1) return '\x1b';
-        if (read(STDIN_FILENO, &seq[1], 1) != 1) return '\x1b';
-        if (seq[0] == '[') {
-            if(seq[1] >= '0' && seq[1] <= '9') {
-                if(read(STDIN_FILENO, &seq[2], 1) != 1) return '\x1b';
-                if (seq[2] == '~') {
-                    switch (seq[1]) {
-                        case '1': return HOME_KEY;
-                        case '3': return DEL_KEY;
-                        case '4': return END_KEY;
-                        case '5': return PAGE_UP;
-                        case '6': return PAGE_DOWN;
-                        case '7': return HOME_KEY;
-                        case '8': return END_KEY;
-                    }
-                }
-            } else {
-                switch (seq[1]) {
-                    case 'A': return ARROW_UP;
-                    case 'B': return ARROW_DOWN;
-                    case 'C': return ARROW_RIGHT;
-                    case 'D': return ARROW_LEFT;
-                    case 'H': return HOME_KEY;
-                    case 'F': return END_KEY;
-                }
-            }
-        } else if(seq[0] == 'O') {
-            switch (seq[1]) {
-                case 'H': return HOME_KEY;
-                case 'F': return END_KEY;
-            }
+int output_flush(int block) {
+    while (output.off < output.ab.len) {
+        ssize_t n = write(STDOUT_FILENO, output.ab.b + output.off, output.ab.len - output.off);
+        if (n > 0) {
+            output.off += n;
+        } else if (n == -1 && errno == EAGAIN) {
+            if (!block) return 0;
+            struct pollfd pfd = { .fd = STDOUT_FILENO, .events = POLLOUT };
+            poll(&pfd, 1, -1);
+        } else if (n == 0 || errno != EINTR) {
+            ec.redraw = 1;
+            break;
         }
-        return 'x1b';
-    } else {
-        return c;
     }
+    abuf_free(&output.ab);
+    output.ab = (abuf_t)ABUF_INIT;
+    output.off = 0;
+    return 1;
 }
 
 /**
- * @brief 获取光标位置
- * @param rows 行数
- * @param cols 列数
- * @return int 返回值
- * @retval -1 获取失败
- * @retval 0  获取成功
+ * @brief 等待终端可读，期间终端可写时继续写出积压的帧
+ * @param deadline 截止时间，参考`now_ns`
+ * @param drain 布尔：积压的帧写完时提前返回
+ * @return int 布尔：终端是否可读
  */
-int get_cursor_position(int *rows, int *cols) {
-    char buf[32];
-    unsigned int i = 0;
-    if (write(STDOUT_FILENO, "\x1b[6n", 4) != 4)
-        return -1;
-    while (i < sizeof(buf) - 1) {
+int term_poll(uint64_t deadline, int drain) {
+    while (1) {
+        struct pollfd pfd[2] = { { .fd = STDIN_FILENO,  .events = POLLIN  },
+                                 { .fd = STDOUT_FILENO, .events = POLLOUT } };
+        int nfds = output.off < output.ab.len ? 2 : 1;
+        uint64_t now = now_ns();
+        int ms = now < deadline ? (int)((deadline - now + 999999) / 1000000) : 0;
+        int ready = poll(pfd, nfds, ms);
+        if (ready == -1 && errno == EINTR) continue;
+        if (ready <= 0) return 0;
+        if (pfd[0].revents) return 1;
+        if (nfds == 2 && pfd[1].revents && output_flush(0) && drain) return 0;
+    }
+}
+
+/**
+ * @brief 从终端批量读入字节到输入缓冲区
+ * @param wait 布尔：没有输入时是否等待（至多`INPUT_WAIT_MS`毫秒）
+ * @return int 读入的字节数
+ * @note 一次只读到环尾，环绕后的部分留给下一次调用。
+ */
+int input_fill(int wait) {
+    if (!term_poll(wait ? now_ns() + INPUT_WAIT_MS * 1000000ull : 0, 0)) return 0;
+    unsigned int used = input.head - input.tail;
+    unsigned int at = input.head & (INPUT_RING - 1);
+    unsigned int room = INPUT_RING - used;
+    if (room > INPUT_RING - at) room = INPUT_RING - at;
+    if (room == 0) return 0;
+    ssize_t n = read(STDIN_FILENO, &input.buf[at], room);
+    if (n == -1 && errno != EAGAIN && errno != EINTR)
+        fatal("read");
+    if (n <= 0) return 0;
+    input.head += n;
+    return n;
+}
+
+/**
+ * @brief 是否还有未处理的输入：缓冲区为空时不等待地读一次终端
+ * @return int 布尔
+ */
+int input_pending() {
+    return input.head != input.tail || input_fill(0) > 0;
+}
+
+/**
+ * @brief 在截止时间前等待输入到达，等待时间记为空闲
+ * @param deadline 截止时间，参考`now_ns`
+ * @return int 布尔：是否有输入
+ * @note 有帧被丢弃时，积压的帧写完就提前返回，好尽快绘制最新的状态。
+ */
+int input_wait(uint64_t deadline) {
+    if (input.head != input.tail) return 1;
+    uint64_t now = now_ns();
+    if (now >= deadline) return 0;
+    int prev = hud_enter(ST_IDLE);
+    int ready = term_poll(deadline, output.stale) && input_fill(0) > 0;
+    hud_enter(prev);
+    return ready;
+}
+
+/**
+ * @brief 查看未解码输入中的第`i`个字节
+ * @param i 偏移
+ * @return int 字节，`-1`表示尚未读入
+ */
+int input_at(unsigned int i) {
+    if (i >= input.head - input.tail) return -1;
+    return input.buf[(input.tail + i) & (INPUT_RING - 1)];
+}
+
+/**
+ * @brief 把 xterm 修饰键参数转为修饰键位
+ * @param m 参数：`1 + (Shift:1 | Alt:2 | Ctrl:4 | Meta:8)`
+ * @return int 修饰键位
+ */
+int editor_key_mods(int m) {
+    int mods = 0;
+    if (m < 2) return 0;
+    m--;
+    if (m & 1) mods |= KEY_SHIFT;
+    if (m & (2 | 8)) mods |= KEY_ALT;
+    if (m & 4) mods |= KEY_CTRL;
+    return mods;
+}
+
+/**
+ * @brief 按`ESC [`或`ESC O`之后的末字节解码方向键、`Home`/`End`与`F1`~`F4`
+ * @param c 末字节
+ * @return int 键码，`KEY_UNKNOWN`表示无法识别
+ */
+int editor_decode_final(int c) {
+    switch (c) {
+        case 'A': return ARROW_UP;
+        case 'B': return ARROW_DOWN;
+        case 'C': return ARROW_RIGHT;
+        case 'D': return ARROW_LEFT;
+        case 'H': return HOME_KEY;
+        case 'F': return END_KEY;
+        case 'P': case 'Q': case 'R': case 'S': return F1_KEY + c - 'P';
+    }
+    return KEY_UNKNOWN;
+}
+
+/**
+ * @brief 解码 CSI 序列：`ESC [ 参数 中间字节 末字节`
+ * @param len 返回序列长度
+ * @return int 键码（含修饰键），`-1`表示序列尚不完整
+ * @note 支持的序列：
+ * - `ESC [ A`~`D/H/F`及带修饰键的`ESC [ 1 ; m A`；
+ * - `ESC [ n ~`：`Home`、`Insert`、`Delete`、`End`、翻页与`F5`~`F12`，可带`; m`；
+ * - `ESC [ Z`：`Shift-Tab`；
+ * - `ESC [ < b ; x ; y M/m`：SGR 鼠标事件，详情存入`input.mouse`。
+ */
+int editor_decode_csi(int *len) {
+    int param[4] = {0};
+    int np = 0;
+    int priv = 0;
+    int i, c;
+    for (i = 2; ; i++) {
+        if (i >= INPUT_SEQ_MAX) {
+            *len = i;
+            return KEY_UNKNOWN;
+        }
+        if ((c = input_at(i)) == -1) return -1;
+        if (c >= '0' && c <= '9') {
+            if (np < 4 && param[np] < 100000) param[np] = param[np] * 10 + c - '0';
+        } else if (c == ';' || c == ':') {
+            np++;
+        } else if (c >= '<' && c <= '?') {
+            priv = c;
+        } else if (c < 0x20 || c > 0x2f) {
+            break;                                  // 末字节
+        }
+    }
+    *len = i + 1;
+    if (priv == '<' && (c == 'M' || c == 'm')) {
+        int b = param[0];
+        input.mouse.button = b & ~(4 | 8 | 16);
+        input.mouse.x = param[1] - 1;
+        input.mouse.y = param[2] - 1;
+        input.mouse.press = (c == 'M');
+        return MOUSE_EVENT | (b & 4 ? KEY_SHIFT : 0) | (b & 8 ? KEY_ALT : 0) |
+                             (b & 16 ? KEY_CTRL : 0);
+    }
+    if (priv) return KEY_UNKNOWN;
+    int mods = editor_key_mods(param[1]);
+    if (c == 'Z') return KEY_SHIFT | '\t';
+    if (c != '~') {
+        int key = editor_decode_final(c);
+        return key == KEY_UNKNOWN ? key : key | mods;
+    }
+    switch (param[0]) {
+        case 1: case 7: return HOME_KEY | mods;
+        case 2:  return INSERT_KEY | mods;
+        case 3:  return DEL_KEY | mods;
+        case 4: case 8: return END_KEY | mods;
+        case 5:  return PAGE_UP | mods;
+        case 6:  return PAGE_DOWN | mods;
+        case 11: case 12: case 13: case 14: case 15:
+            return (F1_KEY + param[0] - 11) | mods;
+        case 17: case 18: case 19: case 20: case 21:
+            return (F1_KEY + 5 + param[0] - 17) | mods;
+        case 23: case 24:
+            return (F1_KEY + 10 + param[0] - 23) | mods;
+    }
+    return KEY_UNKNOWN;
+}
+
+/**
+ * @brief 编辑器解码键入：从输入缓冲区解码一个按键
+ * @param len 返回该按键占用的字节数
+ * @return int 键码，`-1`表示转义序列尚不完整
+ * @note 转义序列
+ * - `ESC [`为 CSI 序列，参考`editor_decode_csi`；
+ * - `ESC O X`为 SS3 序列（小键盘模式下的方向键与`F1`~`F4`），`X`前可带修饰键参数；
+ * - `ESC`后跟其他字节视为`Alt`组合键；
+ * - 单独的`ESC`要等后续字节到达（或超时）才能与序列区分。
+ */
+int editor_decode_key(int *len) {
+    int c = input_at(0);
+    *len = 1;
+    if (c != '\x1b') return c;
+    int c1 = input_at(1);
+    if (c1 == -1) return -1;
+    if (c1 == '[') return editor_decode_csi(len);
+    if (c1 == 'O') {
+        int m = 0, i = 2, c2;
+        while ((c2 = input_at(i)) >= '0' && c2 <= '9' && i < INPUT_SEQ_MAX) {
+            m = m * 10 + c2 - '0';
+            i++;
+        }
+        if (c2 == -1) return -1;
+        *len = i + 1;
+        int key = editor_decode_final(c2);
+        return key == KEY_UNKNOWN ? key : key | editor_key_mods(m);
+    }
+    if (c1 == '\x1b') return '\x1b';
+    *len = 2;
+    return KEY_ALT | c1;
+}
+
+/**
+ * @brief 编辑器读取键入
+ * @return int 键入字符
+ * @note 缓冲区为空时才读终端，一次读入全部已到达的字节，
+ * 因此连续的按键（如按住方向键）只需一次系统调用。
+ * 转义序列不完整时再等待一次，仍未到齐则把已有字节作为单独的`ESC`。
+ * 等待首个字节的时间记为空闲，其后的解码记入`ST_INPUT`阶段。
+ * 等待期间积压的帧写完时补绘被丢弃的帧。
+ */
+int editor_read_key() {
+    int prev = hud_enter(ST_IDLE);
+    while (input.head == input.tail) {
+        if (output.stale && output.off == output.ab.len) editor_refresh_screen();
+        if (term_poll(now_ns() + INPUT_WAIT_MS * 1000000ull, output.stale)) input_fill(0);
+    }
+    hud_enter(ST_INPUT);
+    int len;
+    int key = editor_decode_key(&len);
+    while (key == -1) {
+        if (input_fill(1) == 0) {
+            key = '\x1b';
+            len = input.head - input.tail;
+            break;
+        }
+        key = editor_decode_key(&len);
+    }
+    input.tail += len;
+    if (hud_owner) hud.cur.keys++;
+    hud_enter(prev);
+    return key;
+}
+
+/**
+ * @brief 获取光标位置
+ * @param rows 行数
+ * @param cols 列数
+ * @return int 返回值
+ * @retval -1 获取失败
+ * @retval 0  获取成功
+ */
+int get_cursor_position(int *rows, int *cols) {
+    char buf[32];
+    unsigned int i = 0;
+    if (write(STDOUT_FILENO, "\x1b[6n", 4) != 4)
+        return -1;
+    while (i < sizeof(buf) - 1) {
         if (read(STDIN_FILENO, &buf[i], 1) != 1)
             break;
         if (buf[i] == 'R')
@@ -430,336 +1625,1885 @@ int get_window_size(int *rows, int *cols) {
     }
 }
 
+// ======================================================================= //
+//                                Row Pool
+// ======================================================================= //
+
+/** 块头占用的字节数（保持 16 字节对齐） */
+#define POOL_HDR ((sizeof(pchunk_t) + 15) & ~(size_t)15)
+
+/**
+ * @brief 尺寸分级对应的块大小
+ * @param cls 尺寸分级
+ * @return size_t 字节数：16, 32, 48, 64, 96, 128 ... 4096
+ */
+size_t pool_class_size(int cls) {
+    if (cls == 0) return 16;
+    return cls & 1 ? (size_t)32 << ((cls - 1) / 2) : (size_t)48 << ((cls - 2) / 2);
+}
+
+/**
+ * @brief 查找能容纳`size`字节的最小分级
+ * @param size 字节数
+ * @return int 尺寸分级，`-1`表示超出最大分级
+ */
+int pool_class(size_t size) {
+    for (int cls = 0; cls < POOL_CLASSES; cls++)
+        if (size <= pool_class_size(cls)) return cls;
+    return -1;
+}
+
+/**
+ * @brief 分配新块并挂入池
+ * @param pool 行存储池
+ * @param size 块大小
+ * @return pchunk_t* 新块
+ */
+pchunk_t *pool_chunk_new(epool_t *pool, size_t size) {
+    void *mem;
+    if (posix_memalign(&mem, POOL_CHUNK, size) != 0)
+        fatal("posix_memalign");
+    pchunk_t *ch = mem;
+    ch->prev = NULL;
+    ch->next = pool->chunks;
+    if (pool->chunks) pool->chunks->prev = ch;
+    pool->chunks = ch;
+    return ch;
+}
+
+/**
+ * @brief 获取地址所属的块
+ * @param p 池内地址
+ * @return pchunk_t* 块头
+ */
+pchunk_t *pool_chunk_of(void *p) {
+    return (pchunk_t *)((uintptr_t)p & ~(uintptr_t)(POOL_CHUNK - 1));
+}
+
+/**
+ * @brief 从池中分配内存
+ * @param pool 行存储池
+ * @param size 字节数
+ * @return void* 内存地址
+ */
+void *pool_alloc(epool_t *pool, size_t size) {
+    int cls = pool_class(size);
+    if (cls < 0) {
+        // 大块：独占一个块
+        pchunk_t *ch = pool_chunk_new(pool, POOL_HDR + size);
+        ch->cls = -1;
+        ch->used = size;
+        return (char *)ch + POOL_HDR;
+    }
+    if (pool->free[cls]) {
+        void *p = pool->free[cls];
+        pool->free[cls] = *(void **)p;
+        return p;
+    }
+    size_t csize = pool_class_size(cls);
+    pchunk_t *ch = pool->cur[cls];
+    if (ch == NULL || ch->used + csize > POOL_CHUNK) {
+        ch = pool_chunk_new(pool, POOL_CHUNK);
+        ch->cls = cls;
+        ch->used = POOL_HDR;
+        pool->cur[cls] = ch;
+    }
+    void *p = (char *)ch + ch->used;
+    ch->used += csize;
+    return p;
+}
+
+/**
+ * @brief 获取池内地址的可用容量
+ * @param p 池内地址
+ * @return size_t 字节数
+ */
+size_t pool_size(void *p) {
+    pchunk_t *ch = pool_chunk_of(p);
+    return ch->cls < 0 ? ch->used : pool_class_size(ch->cls);
+}
+
+/**
+ * @brief 归还内存到池
+ * @param pool 行存储池
+ * @param p 池内地址，可为`NULL`
+ */
+void pool_free(epool_t *pool, void *p) {
+    if (p == NULL) return;
+    pchunk_t *ch = pool_chunk_of(p);
+    if (ch->cls < 0) {
+        if (ch->prev) ch->prev->next = ch->next;
+        else pool->chunks = ch->next;
+        if (ch->next) ch->next->prev = ch->prev;
+        free(ch);
+        return;
+    }
+    *(void **)p = pool->free[ch->cls];
+    pool->free[ch->cls] = p;
+}
+
+/**
+ * @brief 调整池内存大小
+ * @param pool 行存储池
+ * @param p 池内地址，可为`NULL`
+ * @param size 新字节数
+ * @return void* 新地址：容量足够时原地返回
+ */
+void *pool_realloc(epool_t *pool, void *p, size_t size) {
+    if (p == NULL) return pool_alloc(pool, size);
+    size_t cap = pool_size(p);
+    if (size <= cap) return p;
+    void *np = pool_alloc(pool, size);
+    memcpy(np, p, cap);
+    pool_free(pool, p);
+    return np;
+}
+
+/**
+ * @brief 整体释放池：关闭文件时调用，代价只与块数有关
+ * @param pool 行存储池
+ */
+void pool_destroy(epool_t *pool) {
+    pchunk_t *ch = pool->chunks;
+    while (ch) {
+        pchunk_t *next = ch->next;
+        free(ch);
+        ch = next;
+    }
+    memset(pool, 0, sizeof(*pool));
+}
+
+// ======================================================================= //
+//                             Highlight Cache
+// ======================================================================= //
+
+/**
+ * @brief 快速哈希：每次处理 8 字节
+ * @param p 数据
+ * @param len 长度
+ * @return uint64_t 哈希值
+ */
+uint64_t hash_bytes(const void *p, size_t len) {
+    const unsigned char *s = p;
+    uint64_t h = 0x9e3779b97f4a7c15ull ^ len;
+    uint64_t w;
+    for (; len >= 8; s += 8, len -= 8) {
+        memcpy(&w, s, 8);
+        h = (h ^ w) * 0xff51afd7ed558ccdull;
+        h ^= h >> 32;
+    }
+    w = 0;
+    memcpy(&w, s, len);
+    h = (h ^ w) * 0xc4ceb9fe1a85ec53ull;
+    return h ^ (h >> 29);
+}
+
+/**
+ * @brief 释放对缓存项的引用
+ * @param e 缓存项
+ */
+void hlc_release(ehlc_entry_t *e) {
+    pthread_mutex_lock(&hlc.lock);
+    int last = (--e->refs == 0);
+    pthread_mutex_unlock(&hlc.lock);
+    if (last) {
+        free(e->render);
+        free(e->hl);
+        free(e);
+    }
+}
+
+/**
+ * @brief 将缓存项从 LRU 链表中摘下
+ * @param e 缓存项
+ * @note 调用者持有锁。
+ */
+void hlc_unlink(ehlc_entry_t *e) {
+    if (e->prev) e->prev->next = e->next; else hlc.head = e->next;
+    if (e->next) e->next->prev = e->prev; else hlc.tail = e->prev;
+    e->prev = e->next = NULL;
+}
+
+/**
+ * @brief 将缓存项放到 LRU 链表表头
+ * @param e 缓存项
+ * @note 调用者持有锁。
+ */
+void hlc_push(ehlc_entry_t *e) {
+    e->next = hlc.head;
+    if (hlc.head) hlc.head->prev = e;
+    hlc.head = e;
+    if (hlc.tail == NULL) hlc.tail = e;
+}
+
+/**
+ * @brief 查找高亮缓存
+ * @param sy 语法定义
+ * @param row 编辑器行
+ * @param in 入口状态
+ * @param hash 渲染内容的哈希
+ * @return ehlc_entry_t* 命中时为已加引用的缓存项，否则为`NULL`
+ */
+ehlc_entry_t *hlc_get(const esyn_t *sy, const erow_t *row, uint32_t in, uint64_t hash) {
+    ehlc_entry_t *e;
+    pthread_mutex_lock(&hlc.lock);
+    hlc.lookups++;
+    for (e = hlc.bucket[hash & (HLC_BUCKETS - 1)]; e; e = e->chain) {
+        if (e->hash == hash && e->in == in && e->syntax == sy && e->rlen == row->rlen &&
+            !memcmp(e->render, row->render, row->rlen))
+            break;
+    }
+    if (e) {
+        hlc.hits++;
+        e->refs++;
+        hlc_unlink(e);
+        hlc_push(e);
+    }
+    pthread_mutex_unlock(&hlc.lock);
+    return e;
+}
+
+/**
+ * @brief 缓存项计入`hlc.bytes`的字节数
+ * @param e 缓存项
+ * @return size_t 字节数
+ */
+size_t hlc_size(const ehlc_entry_t *e) {
+    return sizeof(ehlc_entry_t) + e->rlen + e->num_hl * sizeof(hlspan_t);
+}
+
+/**
+ * @brief 将一行的高亮结果加入缓存，必要时淘汰最久未用的项
+ * @param sy 语法定义
+ * @param row 编辑器行：`hl`与`num_hl`为刚计算的结果
+ * @param in 入口状态
+ * @param out 出口状态
+ * @param hash 渲染内容的哈希
+ */
+void hlc_put(const esyn_t *sy, const erow_t *row, uint32_t in, uint32_t out, uint64_t hash) {
+    ehlc_entry_t *e = calloc(1, sizeof(ehlc_entry_t));
+    if (e == NULL) fatal("calloc");
+    e->hash = hash;
+    e->render = malloc(row->rlen + 1);
+    e->hl = malloc(row->num_hl * sizeof(hlspan_t) + 1);
+    if (e->render == NULL || e->hl == NULL) fatal("malloc");
+    memcpy(e->render, row->render, row->rlen);
+    if (row->num_hl) memcpy(e->hl, row->hl, row->num_hl * sizeof(hlspan_t));
+    e->rlen = row->rlen;
+    e->num_hl = row->num_hl;
+    e->in = in;
+    e->out = out;
+    e->syntax = sy;
+    e->refs = 1;
+
+    ehlc_entry_t *victim = NULL;
+    pthread_mutex_lock(&hlc.lock);
+    ehlc_entry_t **slot = &hlc.bucket[hash & (HLC_BUCKETS - 1)];
+    e->chain = *slot;
+    *slot = e;
+    hlc_push(e);
+    hlc.count++;
+    hlc.bytes += hlc_size(e);
+    // 按项数与字节数淘汰：被淘汰的项先挂成单链，解锁后再释放
+    while (hlc.count > HLC_ENTRIES || hlc.bytes > HLC_BYTES) {
+        ehlc_entry_t *v = hlc.tail;
+        hlc_unlink(v);
+        slot = &hlc.bucket[v->hash & (HLC_BUCKETS - 1)];
+        while (*slot != v) slot = &(*slot)->chain;
+        *slot = v->chain;
+        hlc.count--;
+        hlc.bytes -= hlc_size(v);
+        v->chain = victim;
+        victim = v;
+    }
+    pthread_mutex_unlock(&hlc.lock);
+    while (victim) {
+        ehlc_entry_t *next = victim->chain;
+        hlc_release(victim);
+        victim = next;
+    }
+}
+
 // ======================================================================= //
 //                              Syntax Highlight
 // ======================================================================= //
 
 /**
- * @brief 是否为分隔符
- * @param c 字符
- * @return int 
+ * @brief 关键词哈希：FNV-1a
+ * @param s 字符串
+ * @param len 长度
+ * @return unsigned int 哈希值
+ */
+unsigned int syn_hash(const char *s, int len) {
+    unsigned int h = 2166136261u;
+    for (int i = 0; i < len; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/**
+ * @brief 查找关键词
+ * @param sy 语法定义
+ * @param s 单词起点
+ * @param len 单词长度
+ * @return int 高亮类别，不是关键词时为`HL_NORMAL`
+ */
+int syn_keyword(const esyn_t *sy, const char *s, int len) {
+    if (sy->kw == NULL) return HL_NORMAL;
+    unsigned int i = syn_hash(s, len) & sy->kw_mask;
+    for (; sy->kw[i].s; i = (i + 1) & sy->kw_mask)
+        if (sy->kw[i].len == len && !memcmp(sy->kw[i].s, s, len))
+            return sy->kw[i].cls;
+    return HL_NORMAL;
+}
+
+/**
+ * @brief 向语法定义加入关键词
+ * @param sy 语法定义
+ * @param word 关键词
+ * @param cls 高亮类别
+ * @note 装载因子超过一半时容量翻倍并重新插入。
+ */
+void syn_add_keyword(esyn_t *sy, const char *word, int cls) {
+    unsigned int used = 0;
+    for (unsigned int i = 0; sy->kw && i <= sy->kw_mask; i++)
+        used += sy->kw[i].s != NULL;
+    if (sy->kw == NULL || 2 * (used + 1) > sy->kw_mask + 1) {
+        unsigned int cap = sy->kw ? 2 * (sy->kw_mask + 1) : 64;
+        ekw_t *old = sy->kw;
+        unsigned int old_cap = sy->kw ? sy->kw_mask + 1 : 0;
+        sy->kw = calloc(cap, sizeof(ekw_t));
+        if (sy->kw == NULL) fatal("calloc");
+        sy->kw_mask = cap - 1;
+        for (unsigned int i = 0; i < old_cap; i++) {
+            if (old[i].s == NULL) continue;
+            unsigned int j = syn_hash(old[i].s, old[i].len) & sy->kw_mask;
+            while (sy->kw[j].s) j = (j + 1) & sy->kw_mask;
+            sy->kw[j] = old[i];
+        }
+        free(old);
+    }
+    int len = strlen(word);
+    unsigned int j = syn_hash(word, len) & sy->kw_mask;
+    for (; sy->kw[j].s; j = (j + 1) & sy->kw_mask)
+        if (sy->kw[j].len == len && !memcmp(sy->kw[j].s, word, len)) return;
+    sy->kw[j].s = strdup(word);
+    sy->kw[j].len = len;
+    sy->kw[j].cls = cls;
+}
+
+/**
+ * @brief 高亮类别名转为类别
+ * @param name 类别名
+ * @return int 高亮类别，未知时为`-1`
+ */
+int syn_class(const char *name) {
+    static const char *names[] = {
+        "normal", "string", "number", "comment", "mlcomment", "keyword1", "keyword2"
+    };
+    for (int i = 0; i < (int)(sizeof(names) / sizeof(names[0])); i++)
+        if (!strcmp(name, names[i])) return i;
+    return -1;
+}
+
+/**
+ * @brief 编译语法定义文本，追加到`HLDB`
+ * @param src 定义文本，格式见`SYN_BUILTIN`
+ * @param origin 来源，用于错误信息
+ * @param err 错误信息缓冲区，可为`NULL`
+ * @param err_len 错误信息缓冲区大小
+ * @return int 错误行数，`0`表示全部成功
+ * @note 出错的行被跳过，其余指令照常生效。与已有定义同名时，新定义替换旧定义。
+ */
+int syn_compile(const char *src, const char *origin, char *err, int err_len) {
+    int errors = 0;
+    int lineno = 0;
+    esyn_t *sy = NULL;
+    char *text = strdup(src);
+    char *rest = text;
+    char *line;
+    while ((line = strsep(&rest, "\n")) != NULL) {
+        lineno++;
+        // 每个参数至少占一个字符加一个分隔符，按行长分配参数数组不会放不下
+        int max_args = strlen(line) / 2 + 1;
+        char *save = NULL;
+        char *cmd = strtok_r(line, " \t\r", &save);
+        if (cmd == NULL || cmd[0] == '#') continue;
+        char **arg = malloc(sizeof(char *) * max_args);
+        if (arg == NULL) fatal("malloc");
+        int argc = 0;
+        char *a;
+        while ((a = strtok_r(NULL, " \t\r", &save)) != NULL)
+            arg[argc++] = a;
+
+        int ok = 1;
+        // 规则合法但超出`esyn_t`中固定数组的容量
+        int full = 0;
+        if (!strcmp(cmd, "name") && argc == 1) {
+            int j;
+            for (j = 0; j < HLDB_ENTRIES; j++)
+                if (!strcmp(HLDB[j].filetype, arg[0])) break;
+            if (j == HLDB_ENTRIES) {
+                HLDB = realloc(HLDB, sizeof(esyn_t) * (HLDB_ENTRIES + 1));
+                if (HLDB == NULL) fatal("realloc");
+                HLDB_ENTRIES++;
+            }
+            sy = &HLDB[j];
+            memset(sy, 0, sizeof(esyn_t));
+            sy->filetype = strdup(arg[0]);
+            sy->cc[0] = CC_SEP;
+            for (int c = 1; c < 256; c++) {
+                if (isspace(c) || strchr(SYN_SEPARATORS, c)) sy->cc[c] |= CC_SEP;
+                if (isdigit(c)) sy->cc[c] |= CC_DIGIT;
+            }
+        } else if (sy == NULL) {
+            ok = 0;
+        } else if (!strcmp(cmd, "match") && argc > 0) {
+            full = sy->num_match + argc > SYN_TOKENS * 2;
+            for (int i = 0; i < argc && !full; i++)
+                sy->filematch[sy->num_match++] = strdup(arg[i]);
+        } else if (!strcmp(cmd, "keyword") || !strcmp(cmd, "type")) {
+            for (int i = 0; i < argc; i++)
+                syn_add_keyword(sy, arg[i], cmd[0] == 'k' ? HL_KEYWORD1 : HL_KEYWORD2);
+        } else if (!strcmp(cmd, "comment") && argc > 0) {
+            full = sy->num_line_comment + argc > SYN_TOKENS;
+            for (int i = 0; i < argc && !full; i++) {
+                sy->line_comment[sy->num_line_comment++] = strdup(arg[i]);
+                sy->cc[(unsigned char)arg[i][0]] |= CC_LINE;
+            }
+        } else if (!strcmp(cmd, "block") && (argc == 2 ||
+                   (argc == 3 && !strcmp(arg[2], "nested")))) {
+            sy->block_start = strdup(arg[0]);
+            sy->block_end = strdup(arg[1]);
+            sy->block_nested = (argc == 3);
+            sy->cc[(unsigned char)arg[0][0]] |= CC_BLOCK;
+        } else if (!strcmp(cmd, "mstring") && (argc == 2 ||
+                   (argc == 3 && !strcmp(arg[2], "raw")))) {
+            full = sy->num_mstr == SYN_TOKENS;
+            if (!full) {
+                sy->mstr_start[sy->num_mstr] = strdup(arg[0]);
+                sy->mstr_end[sy->num_mstr] = strdup(arg[1]);
+                sy->mstr_raw[sy->num_mstr++] = (argc == 3);
+                sy->cc[(unsigned char)arg[0][0]] |= CC_MSTR;
+            }
+        } else if (!strcmp(cmd, "rawstring") && argc >= 2 && strlen(arg[argc - 1]) == 1) {
+            full = sy->num_raw + argc - 1 > SYN_TOKENS;
+            for (int i = 0; i < argc - 1 && !full; i++) {
+                sy->raw_prefix[sy->num_raw++] = strdup(arg[i]);
+                sy->cc[(unsigned char)arg[i][0]] |= CC_OPEN;
+            }
+            if (!full) sy->raw_fill = arg[argc - 1][0];
+        } else if (!strcmp(cmd, "heredoc") && argc == 1) {
+            sy->heredoc = strdup(arg[0]);
+            sy->cc[(unsigned char)arg[0][0]] |= CC_OPEN;
+        } else if (!strcmp(cmd, "string") && argc > 0) {
+            for (int i = 0; i < argc; i++)
+                sy->cc[(unsigned char)arg[i][0]] |= CC_QUOTE;
+            sy->flags |= HL_SYN_STRINGS;
+        } else if (!strcmp(cmd, "escape") && argc == 1) {
+            sy->escape = arg[0][0];
+        } else if (!strcmp(cmd, "number") && argc == 0) {
+            sy->flags |= HL_SYN_NUMBERS;
+        } else if (!strcmp(cmd, "separator") && argc > 0) {
+            for (int i = 0; i < argc; i++)
+                for (char *p = arg[i]; *p; p++) sy->cc[(unsigned char)*p] |= CC_SEP;
+        } else if (!strcmp(cmd, "head") && argc == 2 && syn_class(arg[1]) > 0) {
+            full = sy->num_head == SYN_TOKENS;
+            if (!full) {
+                sy->head[sy->num_head] = strdup(arg[0]);
+                sy->head_cls[sy->num_head++] = syn_class(arg[1]);
+                sy->cc[(unsigned char)arg[0][0]] |= CC_HEAD;
+            }
+        } else {
+            ok = 0;
+        }
+        if ((!ok || full) && errors++ == 0 && err) {
+            if (full)
+                snprintf(err, err_len, "%s:%d: too many values for '%s'", origin, lineno, cmd);
+            else
+                snprintf(err, err_len, "%s:%d: bad syntax rule '%s'", origin, lineno, cmd);
+        }
+        free(arg);
+    }
+    free(text);
+    return errors;
+}
+
+/**
+ * @brief 加载语法定义：先编译内置定义，再编译`$TEXC_SYNTAX`目录下的`*.syn`文件
+ * @param err 错误信息缓冲区
+ * @param err_len 错误信息缓冲区大小
+ * @return int 错误行数
+ */
+int syn_load(char *err, int err_len) {
+    int errors = syn_compile(SYN_BUILTIN, "builtin", err, err_len);
+    const char *dir = getenv("TEXC_SYNTAX");
+    if (dir == NULL) return errors;
+    DIR *d = opendir(dir);
+    if (d == NULL) return errors;
+    struct dirent *de;
+    while ((de = readdir(d)) != NULL) {
+        int nlen = strlen(de->d_name);
+        if (nlen < 5 || strcmp(de->d_name + nlen - 4, ".syn")) continue;
+        char path[1024];
+        snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+        FILE *fp = fopen(path, "r");
+        if (fp == NULL) continue;
+        char *src = NULL;
+        size_t cap = 0;
+        ssize_t len = getdelim(&src, &cap, '\0', fp);
+        fclose(fp);
+        if (len > 0)
+            errors += syn_compile(src, de->d_name, errors ? NULL : err, err_len);
+        free(src);
+    }
+    closedir(d);
+    return errors;
+}
+
+/** 线程退出时释放其高亮临时缓冲区 */
+static pthread_key_t hl_scratch_key;
+static pthread_once_t hl_scratch_once = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief 创建`hl_scratch_key`：由`pthread_once`调用一次
+ */
+void editor_hl_scratch_init() {
+    pthread_key_create(&hl_scratch_key, free);
+}
+
+/**
+ * @brief 获取高亮计算用的临时缓冲区
+ * @param len 所需字节数
+ * @return unsigned char* 缓冲区
+ * @note 每个线程各有一份；`editor_hl_scan`每次扫描都新建工作线程，
+ * 因此登记到`hl_scratch_key`，线程退出时释放。
+ */
+unsigned char *editor_hl_scratch(int len) {
+    static __thread unsigned char *buf = NULL;
+    static __thread int cap = 0;
+    if (len > cap) {
+        cap = len > 2 * cap ? len : 2 * cap;
+        buf = realloc(buf, cap);
+        if (buf == NULL) fatal("realloc");
+        pthread_once(&hl_scratch_once, editor_hl_scratch_init);
+        pthread_setspecific(hl_scratch_key, buf);
+    }
+    return buf;
+}
+
+/**
+ * @brief 释放行的高亮区间：归还行存储池
+ * @param b 缓冲区
+ * @param row 编辑器行
+ */
+void editor_row_drop_hl(ebuf_t *b, erow_t *row) {
+    pool_free(&b->pool, row->hl);
+    row->hl = NULL;
+    row->num_hl = 0;
+}
+
+/**
+ * @brief 保存行的高亮结果：把逐字节的类别压缩为区间
+ * @param b 缓冲区
+ * @param row 编辑器行
+ * @param hl 计算得到的逐字节高亮
+ */
+void editor_row_store_hl(ebuf_t *b, erow_t *row, unsigned char *hl) {
+    int n = 0;
+    int j;
+    for (j = 0; j < row->rlen; j++)
+        if (hl[j] != HL_NORMAL && (j == 0 || hl[j] != hl[j - 1])) n++;
+    row->num_hl = n;
+    if (n == 0) {
+        pool_free(&b->pool, row->hl);
+        row->hl = NULL;
+        return;
+    }
+    row->hl = pool_realloc(&b->pool, row->hl, n * sizeof(hlspan_t));
+    hlspan_t *sp = row->hl;
+    for (j = 0; j < row->rlen; ) {
+        int k = j + 1;
+        while (k < row->rlen && hl[k] == hl[j]) k++;
+        if (hl[j] != HL_NORMAL) {
+            sp->start = j;
+            sp->len = k - j;
+            sp->cls = hl[j];
+            sp++;
+        }
+        j = k;
+    }
+}
+
+/**
+ * @brief 查找第一个结束位置在`at`之后的高亮区间
+ * @param row 编辑器行
+ * @param at 渲染位置
+ * @return int 区间下标，等于`row->num_hl`表示不存在
+ */
+int editor_row_span_at(erow_t *row, int at) {
+    int lo = 0, hi = row->num_hl;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (row->hl[mid].start + row->hl[mid].len <= at) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+/**
+ * @brief 判断`r[i]`起是否为定界符`tok`
+ * @param r 渲染字符串
+ * @param n 渲染长度
+ * @param i 位置
+ * @param tok 定界符
+ * @return int 匹配时为定界符长度，否则为`0`
  */
-int is_separator(int c) {
-    return isspace(c) || c == '\0' || strchr(",.()+-/*=~%<>[];", c) != NULL;
+static inline int syn_at(const char *r, int n, int i, const char *tok) {
+    int len = strlen(tok);
+    return (i + len <= n && !memcmp(&r[i], tok, len)) ? len : 0;
 }
 
 /**
- * @brief 编辑器更新语法高亮
+ * @brief 以给定入口状态扫描一行，得到逐字节的高亮类别
+ * @param sy 语法定义
  * @param row 编辑器行
+ * @param in 入口状态
+ * @param hl 输出：逐字节高亮类别，至少`row->rlen`字节
+ * @return uint32_t 出口状态
+ * @note 只读取行与语法定义，不修改任何状态，可在任意线程调用。
  */
-void editor_update_syntax(erow_t *row) {
-    row->hl = realloc(row->hl, row->rlen);
-    memset(row->hl, HL_NORMAL, row->rlen);
-    if(ec.syntax == NULL) return;
-
-    char **keywords = ec.syntax->keywords;
-    char *scs = ec.syntax->singleline_comment_start;
-    char *mcs = ec.syntax->multiline_comment_start;
-    char *mce = ec.syntax->multiline_comment_end;
-    int scs_len = scs ? strlen(scs) : 0;
-    int mcs_len = mcs ? strlen(mcs) : 0;
-    int mce_len = mce ? strlen(mce) : 0;
+uint32_t editor_lex(const esyn_t *sy, const erow_t *row, uint32_t in, unsigned char *hl) {
+    const unsigned char *cc = sy->cc;
+    const char *r = row->render;
+    int n = row->rlen;
+    memset(hl, HL_NORMAL, n);
+
+    if (HS_KIND(in) == HS_HEREDOC) {
+        // here 文档：整行为字符串，去掉首尾空白后等于结束词时结束
+        int s = 0, e = n;
+        while (s < e && isspace((unsigned char)r[s])) s++;
+        while (e > s && isspace((unsigned char)r[e - 1])) e--;
+        memset(hl, HL_STRING, n);
+        return (e > s && ((syn_hash(&r[s], e - s) & 0xffffff) | 1) == HS_ARG(in))
+            ? HS_NORMAL : in;
+    }
+    int depth = (HS_KIND(in) == HS_BLOCK) ? (int)HS_ARG(in) : 0;
+    int mstr = (HS_KIND(in) == HS_MSTRING) ? (int)HS_IDX(in) + 1 : 0;
+    int raw = (HS_KIND(in) == HS_RAW) ? (int)HS_ARG(in) + 1 : 0;
+    uint32_t heredoc = 0;
     int prev_sep = 1;
     int in_string = 0;
-    int in_comment = (row->idx > 0 && ec.row[row->idx - 1].hl_open_comment);
 
     int i = 0;
-    while(i < row->rlen) {
-        char c = row->render[i];
-        unsigned char prev_hl = (i > 0) ? row->hl[i - 1] : HL_NORMAL;
-        if (scs_len && !in_string && !in_comment) {
-            // 处理注释高亮
-            if (!strncmp(&row->render[i], scs, scs_len)) {
-                memset(&row->hl[i], HL_COMMENT, row->rlen- i);
+    if (in == HS_NORMAL && n > 0 && (cc[(unsigned char)r[0]] & CC_HEAD)) {
+        // 处理行首规则
+        for (int t = 0; t < sy->num_head; t++) {
+            if (syn_at(r, n, 0, sy->head[t])) {
+                memset(hl, sy->head_cls[t], n);
+                i = n;
                 break;
             }
         }
-        if (mcs_len && mce_len && !in_string) {
-            // 处理多行注释高亮
-            if (in_comment) {
-                row->hl[i] = HL_MLCOMMENT;
-                if (!strncmp(&row->render[i], mce, mce_len)) {
-                    memset(&row->hl[i], HL_MLCOMMENT, mce_len);
-                    i += mce_len;
-                    in_comment = 0;
-                    prev_sep = 1;
-                    continue;
-                } else {
-                    i++;
-                    continue;
-                }
-            } else if (!strncmp(&row->render[i], mcs, mcs_len)) {
-                memset(&row->hl[i], HL_MLCOMMENT, mcs_len);
-                i += mcs_len;
-                in_comment = 1;
-                continue;
+    }
+    while(i < n) {
+        unsigned char c = r[i];
+        unsigned char k = cc[c];
+        unsigned char prev_hl = (i > 0) ? hl[i - 1] : HL_NORMAL;
+        int len = 0;
+        if (depth) {
+            // 处理多行注释高亮：找结束符，允许嵌套时也找开始符
+            hl[i] = HL_MLCOMMENT;
+            if ((len = syn_at(r, n, i, sy->block_end))) {
+                memset(&hl[i], HL_MLCOMMENT, len);
+                i += len;
+                if (--depth == 0) prev_sep = 1;
+            } else if (sy->block_nested && (len = syn_at(r, n, i, sy->block_start))) {
+                memset(&hl[i], HL_MLCOMMENT, len);
+                i += len;
+                depth++;
+            } else {
+                i++;
             }
+            continue;
         }
-        if (ec.syntax->flags & HL_SYN_STRINGS) {
-            // 处理字符串高亮
-            if (in_string) {
-                row->hl[i] = HL_STRING;
-                if (c == '\\' && i + 1 < row->rlen) {
-                    // 处理转义字符
-                    row->hl[i + 1] = HL_STRING;
-                    i += 2;
-                    continue;
-                }
-                if (c == in_string) in_string = 0;
-                i++;
+        if (mstr) {
+            // 处理多行字符串高亮
+            hl[i] = HL_STRING;
+            if (!sy->mstr_raw[mstr - 1] && sy->escape && c == (unsigned char)sy->escape &&
+                i + 1 < n) {
+                hl[i + 1] = HL_STRING;
+                i += 2;
+            } else if ((len = syn_at(r, n, i, sy->mstr_end[mstr - 1]))) {
+                memset(&hl[i], HL_STRING, len);
+                i += len;
+                mstr = 0;
                 prev_sep = 1;
-                continue;
             } else {
-                if (c == '"' || c == '\'') {
-                    in_string = c;
-                    row->hl[i] = HL_STRING;
-                    i++;
-                    continue;
+                i++;
+            }
+            continue;
+        }
+        if (raw) {
+            // 处理原始字符串高亮：引号后须跟同样个数的填充字符
+            hl[i] = HL_STRING;
+            i++;
+            if (c == '"' && i + raw - 1 <= n) {
+                int f = 0;
+                while (f < raw - 1 && r[i + f] == sy->raw_fill) f++;
+                if (f == raw - 1) {
+                    memset(&hl[i], HL_STRING, f);
+                    i += f;
+                    raw = 0;
+                    prev_sep = 1;
                 }
             }
+            continue;
         }
-        if (ec.syntax->flags & HL_SYN_NUMBERS) {
-            // 处理数字高亮
-            if ((isdigit(c) && (prev_sep || prev_hl == HL_NUMBER)) ||
-                (c == '.' && prev_hl == HL_NUMBER)) {
-                row->hl[i] = HL_NUMBER;
+        if ((k & CC_LINE) && !in_string) {
+            // 处理注释高亮
+            int t;
+            for (t = 0; t < sy->num_line_comment; t++)
+                if (syn_at(r, n, i, sy->line_comment[t])) break;
+            if (t < sy->num_line_comment) {
+                memset(&hl[i], HL_COMMENT, n - i);
+                break;
+            }
+        }
+        if ((k & CC_BLOCK) && !in_string && (len = syn_at(r, n, i, sy->block_start))) {
+            // 处理多行注释高亮
+            memset(&hl[i], HL_MLCOMMENT, len);
+            i += len;
+            depth = 1;
+            continue;
+        }
+        if (in_string) {
+            // 处理字符串高亮
+            hl[i] = HL_STRING;
+            if (sy->escape && c == (unsigned char)sy->escape && i + 1 < n) {
+                // 处理转义字符
+                hl[i + 1] = HL_STRING;
+                i += 2;
+                continue;
+            }
+            if (c == in_string) in_string = 0;
+            i++;
+            prev_sep = 1;
+            continue;
+        }
+        if (k & CC_MSTR) {
+            int t;
+            for (t = 0; t < sy->num_mstr; t++)
+                if ((len = syn_at(r, n, i, sy->mstr_start[t]))) break;
+            if (t < sy->num_mstr) {
+                memset(&hl[i], HL_STRING, len);
+                i += len;
+                mstr = t + 1;
+                continue;
+            }
+        }
+        if (k & CC_OPEN) {
+            // 原始字符串：单词开头的前缀、若干填充字符与引号
+            for (int t = 0; prev_sep && t < sy->num_raw; t++) {
+                if (!(len = syn_at(r, n, i, sy->raw_prefix[t]))) continue;
+                int f = 0;
+                while (i + len + f < n && r[i + len + f] == sy->raw_fill) f++;
+                if (i + len + f < n && r[i + len + f] == '"') {
+                    memset(&hl[i], HL_STRING, len + f + 1);
+                    i += len + f + 1;
+                    raw = f + 1;
+                    break;
+                }
+            }
+            if (raw) continue;
+            // here 文档：开始符、可选的`-`或`~`与引号、结束词
+            if (sy->heredoc && (len = syn_at(r, n, i, sy->heredoc))) {
+                int s = i + len;
+                if (s < n && (r[s] == '-' || r[s] == '~')) s++;
+                if (s < n && (r[s] == '\'' || r[s] == '"')) s++;
+                int e = s;
+                while (e < n && (isalnum((unsigned char)r[e]) || r[e] == '_')) e++;
+                if (e > s) {
+                    heredoc = (syn_hash(&r[s], e - s) & 0xffffff) | 1;
+                    if (e < n && (r[e] == '\'' || r[e] == '"')) e++;
+                    memset(&hl[i], HL_STRING, e - i);
+                    i = e;
+                    prev_sep = 1;
+                    continue;
+                }
+            }
+        }
+        if (k & CC_QUOTE) {
+            in_string = c;
+            hl[i] = HL_STRING;
+            i++;
+            continue;
+        }
+        if (sy->flags & HL_SYN_NUMBERS) {
+            // 处理数字高亮
+            if (((k & CC_DIGIT) && (prev_sep || prev_hl == HL_NUMBER)) ||
+                (c == '.' && prev_hl == HL_NUMBER)) {
+                hl[i] = HL_NUMBER;
                 i++;
                 prev_sep = 0;
                 continue;
             } // if isdigit
         } // if syntax
-        if (prev_sep) {
-            int j;
-            for (j = 0; keywords[j]; j++) {
-                int klen = strlen(keywords[j]);
-                int kw2 = keywords[j][klen - 1] == '|';
-                if (kw2) klen--;
-                if (!strncmp(&row->render[i], keywords[j], klen) &&
-                    is_separator(row->render[i + klen])) {
-                memset(&row->hl[i], kw2 ? HL_KEYWORD2 : HL_KEYWORD1, klen);
-                i += klen;
-                break;
-                }
-            }
-            if (keywords[j] != NULL) {
+        if (prev_sep && !(k & CC_SEP)) {
+            // 处理关键词：取到下一个分隔符为止的单词查哈希表
+            int end = i + 1;
+            while (end < n && !(cc[(unsigned char)r[end]] & CC_SEP)) end++;
+            int cls = syn_keyword(sy, &r[i], end - i);
+            if (cls != HL_NORMAL) {
+                memset(&hl[i], cls, end - i);
+                i = end;
                 prev_sep = 0;
                 continue;
             }
         }
-        prev_sep = is_separator(c);
+        prev_sep = k & CC_SEP;
         i++;
     } // while
-    int changed = (row->hl_open_comment != in_comment);
-    row->hl_open_comment = in_comment;
-    if (changed && row->idx + 1 < ec.num_rows)
-        editor_update_syntax(&ec.row[row->idx + 1]);
+    if (depth)   return HS_MAKE(HS_BLOCK, 0, depth);
+    if (mstr)    return HS_MAKE(HS_MSTRING, mstr - 1, 0);
+    if (raw)     return HS_MAKE(HS_RAW, 0, raw - 1);
+    if (heredoc) return HS_MAKE(HS_HEREDOC, 0, heredoc);
+    return HS_NORMAL;
+}
+
+/**
+ * @brief 丢弃第`at`行之后的检查点
+ * @param b 缓冲区
+ * @param at 行号：该行的出口状态或其后的行号发生了变化
+ */
+void editor_hl_truncate(ebuf_t *b, int at) {
+    if (at / HL_CKPT + 1 < b->num_ckpt) b->num_ckpt = at / HL_CKPT + 1;
+}
+
+/**
+ * @brief 以给定入口状态更新一行的语法高亮
+ * @param b 缓冲区
+ * @param row 编辑器行
+ * @param in 入口状态
+ * @param spans 布尔：是否生成高亮区间；否则只计算出口状态
+ * @param store 布尔：未命中时是否把结果加入高亮缓存
+ * @note 不会继续更新后续行：后续行在绘制时按入口状态是否一致自行校验。
+ * 生成区间时先查高亮缓存，内容、入口状态与语法定义都相同的行直接复制缓存项的区间。
+ * 刚编辑过的行内容多半不会再出现，不加入缓存；超过`HLC_MAX_LEN`的长行既不查询也不缓存，
+ * 以免每次编辑都复制一整行。
+ */
+void editor_update_syntax(ebuf_t *b, erow_t *row, uint32_t in, int spans, int store) {
+    TRACE_SCOPE("editor_update_syntax");
+    int prev_stage = hud_enter(ST_HIGHLIGHT);
+    int i = row->idx;
+    b->hs_in[i] = in;
+    b->flags[i] = (b->flags[i] & ~RF_HL_VALID) | RF_HL_KNOWN | (spans ? RF_HL_VALID : 0);
+    if (spans) editor_row_stamp(b, i);
+    uint64_t hash = 0;
+    int cached = spans && b->syntax && row->rlen <= HLC_MAX_LEN;
+    if (cached) {
+        // 先查高亮缓存，命中时把区间复制到行存储池，行不持有缓存项
+        hash = hash_bytes(row->render, row->rlen);
+        ehlc_entry_t *e = hlc_get(b->syntax, row, in, hash);
+        if (e) {
+            row->num_hl = e->num_hl;
+            if (e->num_hl) {
+                row->hl = pool_realloc(&b->pool, row->hl, e->num_hl * sizeof(hlspan_t));
+                memcpy(row->hl, e->hl, e->num_hl * sizeof(hlspan_t));
+            } else {
+                editor_row_drop_hl(b, row);
+            }
+            b->hs_out[i] = e->out;
+            hlc_release(e);
+            if (hud_owner) hud.cur.hl_hits++;
+            hud_enter(prev_stage);
+            return;
+        }
+    }
+    if (hud_owner) hud.cur.hl_rows++;
+    unsigned char *hl = editor_hl_scratch(row->rlen);
+    if (b->syntax == NULL) {
+        memset(hl, HL_NORMAL, row->rlen);
+        b->hs_out[i] = HS_NORMAL;
+    } else {
+        b->hs_out[i] = editor_lex(b->syntax, row, in, hl);
+    }
+    if (spans) editor_row_store_hl(b, row, hl);
+    if (cached && store) hlc_put(b->syntax, row, in, b->hs_out[i], hash);
+    hud_enter(prev_stage);
+}
+
+/**
+ * @brief 行内容改变后更新其词法状态
+ * @param b 缓冲区
+ * @param row 编辑器行
+ * @note 沿用原入口状态重新扫描；出口状态改变时丢弃之后的检查点。
+ * 检查点之前的行入口状态都是正确的，因此这样的比较足以判断检查点是否失效。
+ * 从未扫描过的行（如刚读入的行）推迟到需要时再扫描。
+ */
+void editor_hl_edit(ebuf_t *b, erow_t *row) {
+    int i = row->idx;
+    if (!(b->flags[i] & RF_HL_KNOWN)) {
+        editor_hl_truncate(b, i);
+        return;
+    }
+    uint32_t old = b->hs_out[i];
+    editor_update_syntax(b, row, b->hs_in[i], b->flags[i] & RF_HL_VALID, 0);
+    if (b->hs_out[i] != old) editor_hl_truncate(b, i);
+}
+
+/**
+ * @brief 并行扫描的一块
+ */
+typedef struct ehl_job {
+    ebuf_t *b;
+    /** 行区间 [lo, hi) */
+    int lo, hi;
+    /** 入口状态：第一块为真实状态，其余块推测为`HS_NORMAL` */
+    uint32_t in;
+    pthread_t tid;
+} ehl_job_t;
+
+/**
+ * @brief 并行扫描的工作线程：按块内的入口状态依次扫描各行的状态
+ * @param arg 块，参考`ehl_job_t`
+ * @return void* 无
+ * @note 各块只写自己的行，且不生成高亮区间，因此不触及行存储池。
+ */
+void *editor_hl_worker(void *arg) {
+    ehl_job_t *job = arg;
+    ebuf_t *b = job->b;
+    uint32_t st = job->in;
+    for (int i = job->lo; i < job->hi; i++) {
+        if (!(b->flags[i] & RF_HL_KNOWN) || b->hs_in[i] != st)
+            editor_update_syntax(b, &b->row[i], st, 0, 0);
+        st = b->hs_out[i];
+    }
+    return NULL;
+}
+
+/**
+ * @brief 分块并行扫描`[lo, hi)`行的词法状态
+ * @param b 缓冲区
+ * @param lo 起始行
+ * @param hi 结束行（不含）
+ * @param in 第`lo`行的入口状态
+ * @note 除第一块外都假设块首处于常态，随后按顺序检查各块边界：
+ * 推测正确的块整块跳过；推测错误的块从头重新扫描，直到某行的入口状态
+ * 与推测结果一致为止，其后各行必然也一致。线程数默认取在线处理器数，
+ * 可由`$TEXC_THREADS`指定。
+ */
+void editor_hl_scan(ebuf_t *b, int lo, int hi, uint32_t in) {
+    static int threads = 0;
+    if (threads == 0) {
+        const char *env = getenv("TEXC_THREADS");
+        threads = env ? atoi(env) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+        if (threads < 1) threads = 1;
+        if (threads > HL_THREADS_MAX) threads = HL_THREADS_MAX;
+    }
+    TRACE_SCOPE("editor_hl_scan");
+    int n = threads;
+    if ((hi - lo) / n < HL_CKPT) n = 1;
+    ehl_job_t jobs[HL_THREADS_MAX];
+    for (int c = 0; c < n; c++) {
+        jobs[c].b = b;
+        jobs[c].lo = lo + (int)((long long)(hi - lo) * c / n);
+        jobs[c].hi = lo + (int)((long long)(hi - lo) * (c + 1) / n);
+        jobs[c].in = (c == 0) ? in : HS_NORMAL;
+    }
+    int prev_stage = hud_enter(ST_HIGHLIGHT);
+    for (int c = 1; c < n; c++)
+        if (pthread_create(&jobs[c].tid, NULL, editor_hl_worker, &jobs[c]) != 0)
+            jobs[c].tid = pthread_self();
+    editor_hl_worker(&jobs[0]);
+    for (int c = 1; c < n; c++) {
+        if (pthread_equal(jobs[c].tid, pthread_self())) editor_hl_worker(&jobs[c]);
+        else pthread_join(jobs[c].tid, NULL);
+    }
+    hud_enter(prev_stage);
+
+    // 顺序修正块边界
+    uint32_t st = b->hs_out[jobs[0].hi - 1];
+    for (int c = 1; c < n; c++) {
+        for (int i = jobs[c].lo; i < jobs[c].hi; i++) {
+            if (b->hs_in[i] == st) {
+                st = b->hs_out[jobs[c].hi - 1];
+                break;
+            }
+            editor_update_syntax(b, &b->row[i], st, 0, 0);
+            st = b->hs_out[i];
+        }
+    }
+}
+
+/**
+ * @brief 获取第`at`行的入口状态
+ * @param b 缓冲区
+ * @param at 行号
+ * @return uint32_t 入口状态
+ * @note 从不超过`at`的最近检查点出发，沿途入口状态一致的行直接取出口状态，
+ * 否则只扫描状态、不生成高亮区间；经过检查点位置时顺便记录新的检查点。
+ * 因此跳转到任意行只需扫描不超过`HL_CKPT`行（检查点已覆盖时）；
+ * 首次跳到很远的行时，先由`editor_hl_scan`并行扫描中间各行。
+ */
+uint32_t editor_hl_entry(ebuf_t *b, int at) {
+    if (b->ckpt == NULL) {
+        b->ckpt = malloc(sizeof(uint32_t));
+        if (b->ckpt == NULL) fatal("malloc");
+        b->ckpt[0] = HS_NORMAL;
+        b->num_ckpt = 1;
+    }
+    if (at > b->num_rows) at = b->num_rows;
+    int k = at / HL_CKPT;
+    if (k >= b->num_ckpt) k = b->num_ckpt - 1;
+    uint32_t st = b->ckpt[k];
+    if (at - k * HL_CKPT >= HL_PAR_ROWS) editor_hl_scan(b, k * HL_CKPT, at, st);
+    for (int i = k * HL_CKPT; i < at; i++) {
+        if (i % HL_CKPT == 0 && i / HL_CKPT == b->num_ckpt) {
+            b->ckpt = realloc(b->ckpt, sizeof(uint32_t) * (b->num_ckpt + 1));
+            if (b->ckpt == NULL) fatal("realloc");
+            b->ckpt[b->num_ckpt++] = st;
+        }
+        if (!(b->flags[i] & RF_HL_KNOWN) || b->hs_in[i] != st)
+            editor_update_syntax(b, &b->row[i], st, 0, 0);
+        st = b->hs_out[i];
+    }
+    return st;
+}
+
+/**
+ * @brief 确保`[lo, hi)`行的高亮区间有效
+ * @param b 缓冲区
+ * @param lo 起始行
+ * @param hi 结束行（不含）
+ * @note 只为这些行生成高亮区间；其上方的行至多扫描`HL_CKPT`行的状态。
+ */
+void editor_hl_sync(ebuf_t *b, int lo, int hi) {
+    if (hi > b->num_rows) hi = b->num_rows;
+    if (lo >= hi) return;
+    TRACE_SCOPE("editor_hl_sync");
+    uint32_t st = editor_hl_entry(b, lo);
+    for (int i = lo; i < hi; i++) {
+        if (!(b->flags[i] & RF_HL_VALID) || b->hs_in[i] != st)
+            editor_update_syntax(b, &b->row[i], st, 1, 1);
+        st = b->hs_out[i];
+    }
+}
+
+/**
+ * @brief 使缓冲区的全部词法状态与高亮失效
+ * @param b 缓冲区
+ * @note 切换语法定义后调用，实际计算推迟到绘制时。
+ */
+void editor_hl_reset(ebuf_t *b) {
+    if (b->num_rows) memset(b->flags, 0, b->num_rows);
+    editor_hl_truncate(b, 0);
+    b->version++;
+}
+
+/**
+ * @brief 编辑器匹配文件名的语法高亮
+ * @param b 缓冲区
+ */
+void editor_select_syntax_highlight(ebuf_t *b) {
+    b->syntax = NULL;
+    if (b->filename == NULL)
+        return;
+    char *ext = strrchr(b->filename, '.');
+    for (int j = 0; j < HLDB_ENTRIES; j++) {
+        esyn_t *s = &HLDB[j];
+        for (int i = 0; i < s->num_match; i++) {
+            int is_ext = (s->filematch[i][0] == '.');
+            if ((is_ext && ext && !strcmp(ext, s->filematch[i])) ||
+                (!is_ext && strstr(b->filename, s->filematch[i]))) {
+                b->syntax = s;
+                editor_hl_reset(b);
+                return;
+            }
+        }
+    }
+}
+
+
+// ======================================================================= //
+//                                 Theme
+// ======================================================================= //
+
+/**
+ * @brief 24 位颜色转为最接近的 xterm 256 色下标
+ * @param rgb 颜色`0xRRGGBB`
+ * @return int 下标：`16`~`231`为 6x6x6 色块，`232`~`255`为灰阶
+ */
+int theme_rgb256(int rgb) {
+    int v[3] = { (rgb >> 16) & 0xff, (rgb >> 8) & 0xff, rgb & 0xff };
+    int q[3], d = 0;
+    for (int i = 0; i < 3; i++) {
+        // 色块每级的取值：0, 95, 135, 175, 215, 255
+        q[i] = v[i] < 48 ? 0 : v[i] < 115 ? 1 : (v[i] - 35) / 40;
+        int lv = q[i] ? 55 + q[i] * 40 : 0;
+        d += (v[i] - lv) * (v[i] - lv);
+    }
+    // 灰阶每级的取值：8, 18, ..., 238
+    int avg = (v[0] + v[1] + v[2]) / 3;
+    int g = avg < 8 ? 0 : avg > 238 ? 23 : (avg - 3) / 10;
+    int gv = 8 + g * 10, gd = 0;
+    for (int i = 0; i < 3; i++) gd += (v[i] - gv) * (v[i] - gv);
+    return gd < d ? 232 + g : 16 + q[0] * 36 + q[1] * 6 + q[2];
+}
+
+/**
+ * @brief 根据环境变量推断终端的颜色深度
+ * @return int 颜色深度，参考`editor_depth`
+ * @note `$COLORTERM`为`truecolor`或`24bit`时为真彩色，
+ * `$TERM`含`256color`时为 256 色，否则为 16 色。
+ */
+int theme_detect() {
+    const char *ct = getenv("COLORTERM");
+    if (ct && (!strcmp(ct, "truecolor") || !strcmp(ct, "24bit"))) return CD_TRUE;
+    const char *term = getenv("TERM");
+    if (term && strstr(term, "256color")) return CD_256;
+    return CD_16;
+}
+
+/**
+ * @brief 按颜色深度编译主题到`ec.theme`
+ * @param name 主题名，`NULL`为`default`
+ * @param depth 颜色深度，参考`editor_depth`
+ * @return int 返回值
+ * @retval -1 没有该主题，改用`default`
+ * @retval 0  成功
+ */
+int theme_load(const char *name, int depth) {
+    int t = 0;
+    if (name) {
+        while (t < (int)THEME_ENTRIES && strcmp(THEMES[t].name, name)) t++;
+        if (t == (int)THEME_ENTRIES) {
+            theme_load(NULL, depth);
+            return -1;
+        }
+    }
+    etheme_t *th = &ec.theme;
+    th->name = THEMES[t].name;
+    th->depth = depth;
+    for (int cls = 0; cls < HL_NUM; cls++) {
+        int rgb = THEMES[t].rgb[cls];
+        char *sgr = th->sgr[cls];
+        int n;
+        if (rgb < 0 || depth == CD_16)
+            n = snprintf(sgr, sizeof(th->sgr[0]), "\x1b[%dm", THEMES[t].ansi[cls]);
+        else if (depth == CD_256)
+            n = snprintf(sgr, sizeof(th->sgr[0]), "\x1b[38;5;%dm", theme_rgb256(rgb));
+        else
+            n = snprintf(sgr, sizeof(th->sgr[0]), "\x1b[38;2;%d;%d;%dm",
+                         (rgb >> 16) & 0xff, (rgb >> 8) & 0xff, rgb & 0xff);
+        th->len[cls] = n;
+        int a = 0;
+        while (strcmp(th->sgr[a], sgr)) a++;
+        th->alias[cls] = a;
+    }
+    return 0;
+}
+
+
+// ======================================================================= //
+//                            Row Operations
+// ======================================================================= //
+
+/**
+ * @brief 检查字符串是否为纯 ASCII
+ * @param s 字符串
+ * @param len 长度
+ * @return int 布尔
+ * @note 有 SSE2 时每次检查 16 字节，否则每次检查 8 字节。
+ */
+int is_ascii(const char *s, int len) {
+    int i = 0;
+#ifdef __SSE2__
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+        if (_mm_movemask_epi8(v)) return 0;
+    }
+#else
+    for (; i + 8 <= len; i += 8) {
+        uint64_t w;
+        memcpy(&w, s + i, 8);
+        if (w & 0x8080808080808080ull) return 0;
+    }
+#endif
+    for (; i < len; i++)
+        if ((unsigned char)s[i] & 0x80) return 0;
+    return 1;
+}
+
+/**
+ * @brief 跳过可直接输出的字节：可打印 ASCII 字符（`0x20`~`0x7E`）
+ * @param s 字符串
+ * @param len 长度
+ * @return int 开头连续可直接输出的字节数
+ * @note 有 SSE2 时每次检查 16 字节：按有符号比较，小于`0x20`的同时也覆盖了
+ * 最高位为 1 的字节，再加上`0x7F`；否则每次检查 8 字节。
+ */
+int scan_plain(const char *s, int len) {
+    int i = 0;
+#ifdef __SSE2__
+    const __m128i sp = _mm_set1_epi8(0x20), del = _mm_set1_epi8(0x7f);
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+        int m = _mm_movemask_epi8(_mm_or_si128(_mm_cmplt_epi8(v, sp), _mm_cmpeq_epi8(v, del)));
+        if (m) return i + __builtin_ctz(m);
+    }
+#else
+    for (; i + 8 <= len; i += 8) {
+        uint64_t w, w7;
+        memcpy(&w, s + i, 8);
+        w7 = w & 0x7f7f7f7f7f7f7f7full;
+        // 逐字节：最高位为 1、小于`0x20`（加`0x60`不进位到最高位）、等于`0x7F`（加 1 进位）
+        if ((w | ~(w7 + 0x6060606060606060ull) | (w7 + 0x0101010101010101ull)) &
+            0x8080808080808080ull) break;
+    }
+#endif
+    for (; i < len; i++) {
+        unsigned char ch = s[i];
+        if (ch < 0x20 || ch >= 0x7f) break;
+    }
+    return i;
+}
+
+/**
+ * @brief 解码一个 UTF-8 字符
+ * @param s 字符串
+ * @param len 剩余长度
+ * @param n 输出：字符字节数
+ * @return int 码点，`-1`表示非法字节（此时`n`为 1）
+ */
+int utf8_decode(const char *s, int len, int *n) {
+    const unsigned char *u = (const unsigned char *)s;
+    int cp, need;
+    *n = 1;
+    if (u[0] < 0x80) return u[0];
+    if ((u[0] & 0xE0) == 0xC0) { cp = u[0] & 0x1F; need = 1; }
+    else if ((u[0] & 0xF0) == 0xE0) { cp = u[0] & 0x0F; need = 2; }
+    else if ((u[0] & 0xF8) == 0xF0) { cp = u[0] & 0x07; need = 3; }
+    else return -1;
+    if (need >= len) return -1;
+    for (int i = 1; i <= need; i++) {
+        if ((u[i] & 0xC0) != 0x80) return -1;
+        cp = (cp << 6) | (u[i] & 0x3F);
+    }
+    // 拒绝过长编码、代理区与超出范围的码点
+    if ((need == 1 && cp < 0x80) || (need == 2 && cp < 0x800) ||
+        (need == 3 && cp < 0x10000) || cp > 0x10FFFF ||
+        (cp >= 0xD800 && cp <= 0xDFFF))
+        return -1;
+    *n = need + 1;
+    return cp;
+}
+
+/**
+ * @brief 码点的显示宽度
+ * @param cp 码点
+ * @return int 列数：0、1 或 2
+ */
+int char_width(int cp) {
+    int lo = 0, hi = WIDTH_ENTRIES;
+    if (cp < 0x300) return 1;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if ((uint32_t)cp > WIDTH_TABLE[mid].hi) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo < (int)WIDTH_ENTRIES && (uint32_t)cp >= WIDTH_TABLE[lo].lo)
+        return WIDTH_TABLE[lo].w;
+    return 1;
+}
+
+/**
+ * @brief 列索引项在某单位下的起始位置
+ * @param e 列索引项
+ * @param unit 单位，参考`editor_unit`
+ * @return int 位置
+ */
+int ecol_pos(ecol_t *e, int unit) {
+    return unit == U_CHARS ? e->cx : unit == U_RENDER ? e->bx : e->rx;
+}
+
+/**
+ * @brief 列索引项在某单位下的长度
+ * @param e 列索引项
+ * @param unit 单位，参考`editor_unit`
+ * @return int 长度：制表符在`render`中展开为`w`个空格
+ */
+int ecol_ext(ecol_t *e, int unit) {
+    if (unit == U_CHARS) return e->n;
+    if (unit == U_RENDER && e->kind != COL_TAB) return e->n;
+    return e->w;
+}
+
+/**
+ * @brief 二分查找：起始位置不超过`at`的列索引项数
+ * @param row 编辑器行
+ * @param unit 单位
+ * @param at 位置
+ * @return int 项数，其前一项即`at`所在或之前最近的不规则字符
+ */
+int editor_row_col_count(erow_t *row, int unit, int at) {
+    int lo = 0, hi = row->num_cols;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (ecol_pos(&row->cols[mid], unit) <= at) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+/**
+ * @brief 行内位置换算
+ * @param row 编辑器行
+ * @param from 原单位
+ * @param to 目标单位
+ * @param at 原位置
+ * @return int 目标位置：落在字符内部时返回该字符的起点
+ * （制表符内部的渲染字节与显示列一一对应）
+ */
+int editor_row_map(erow_t *row, int from, int to, int at) {
+    int k = editor_row_col_count(row, from, at);
+    if (k == 0) return at;
+    ecol_t *e = &row->cols[k - 1];
+    int off = at - ecol_pos(e, from);
+    if (off < ecol_ext(e, from)) {
+        if (e->kind == COL_TAB && from != U_CHARS && to != U_CHARS)
+            return ecol_pos(e, to) + off;
+        return ecol_pos(e, to);
+    }
+    return ecol_pos(e, to) + ecol_ext(e, to) + off - ecol_ext(e, from);
+}
+
+/**
+ * @brief 将字符索引转换为渲染索引
+ * @param row 编辑器行
+ * @param cx 字符索引
+ * @return int 显示列
+ */
+int editor_row_cx2rx(erow_t *row, int cx) {
+    return editor_row_map(row, U_CHARS, U_COLS, cx);
+}
+
+/**
+ * @brief 将渲染索引转换为字符索引
+ * @param row 编辑器行
+ * @param rx 显示列
+ * @return int 字符索引：显示列`rx`所在的字符
+ */
+int editor_row_rx2cx(erow_t *row, int rx) {
+    int cx = editor_row_map(row, U_COLS, U_CHARS, rx);
+    return cx < row->len ? cx : row->len;
+}
+
+/**
+ * @brief 字符索引所在字符的起点
+ * @param row 编辑器行
+ * @param cx 字符索引
+ * @return int 字符起点
+ */
+int editor_row_char_start(erow_t *row, int cx) {
+    if (cx >= row->len) return row->len;
+    return editor_row_map(row, U_CHARS, U_CHARS, cx);
+}
+
+/**
+ * @brief 下一个字符的字符索引
+ * @param row 编辑器行
+ * @param cx 字符索引（位于字符起点）
+ * @return int 字符索引
+ */
+int editor_row_next_char(erow_t *row, int cx) {
+    int k = editor_row_col_count(row, U_CHARS, cx);
+    if (k > 0 && row->cols[k - 1].cx == cx)
+        return cx + row->cols[k - 1].n;
+    return cx + 1;
+}
+
+/**
+ * @brief 上一个字符的字符索引
+ * @param row 编辑器行
+ * @param cx 字符索引（大于`0`）
+ * @return int 字符索引
+ */
+int editor_row_prev_char(erow_t *row, int cx) {
+    return editor_row_char_start(row, cx - 1);
+}
+
+/**
+ * @brief 获取建立列索引用的临时缓冲区
+ * @param n 所需项数
+ * @return ecol_t* 缓冲区
+ * @note 每个线程各有一份。
+ */
+ecol_t *editor_col_scratch(int n) {
+    static __thread ecol_t *buf = NULL;
+    static __thread int cap = 0;
+    if (n > cap) {
+        cap = n > 2 * cap ? n : 2 * cap;
+        buf = realloc(buf, cap * sizeof(ecol_t));
+        if (buf == NULL) fatal("realloc");
+    }
+    return buf;
+}
+
+/**
+ * @brief 行记录移动后修正指向内联存储的指针
+ * @param row 编辑器行（已位于新地址）
+ */
+void editor_row_rebase(erow_t *row) {
+    if (!row->inl_c) return;
+    row->c = row->inl;
+    if (row->render_alias) row->render = row->c;
+    else if (row->inl_r) row->render = row->inl + row->len + 1;
+}
+
+/**
+ * @brief 确保`c`至少能容纳`size`字节，必要时从内联存储迁出到行存储池
+ * @param b 缓冲区
+ * @param row 编辑器行：非驻留行
+ * @param size 字节数（含结尾`\0`）
+ * @note 迁出后`render`可能仍指向内联存储中的旧内容，调用者修改`c`后须更新行。
+ */
+void editor_row_reserve(ebuf_t *b, erow_t *row, size_t size) {
+    if (!row->inl_c) {
+        row->c = pool_realloc(&b->pool, row->c, size);
+        return;
+    }
+    if (size <= ROW_INLINE) return;
+    char *c = pool_alloc(&b->pool, size);
+    memcpy(c, row->c, row->len + 1);
+    row->c = c;
+    row->inl_c = 0;
+}
+
+/**
+ * @brief 按`row_cap`调整各行元数据数组的容量
+ * @param b 缓冲区
+ */
+void editor_meta_resize(ebuf_t *b) {
+    b->lens = realloc(b->lens, sizeof(int) * b->row_cap);
+    b->rlens = realloc(b->rlens, sizeof(int) * b->row_cap);
+    b->hs_in = realloc(b->hs_in, sizeof(uint32_t) * b->row_cap);
+    b->hs_out = realloc(b->hs_out, sizeof(uint32_t) * b->row_cap);
+    b->flags = realloc(b->flags, b->row_cap);
+    b->stamps = realloc(b->stamps, sizeof(uint32_t) * b->row_cap);
+    if (!b->lens || !b->rlens || !b->hs_in || !b->hs_out || !b->flags || !b->stamps)
+        fatal("realloc");
+}
+
+/**
+ * @brief 随行记录一起移动各行元数据
+ * @param b 缓冲区
+ * @param dst 目标行号
+ * @param src 源行号
+ * @param n 行数
+ */
+void editor_meta_move(ebuf_t *b, int dst, int src, int n) {
+    memmove(&b->lens[dst], &b->lens[src], sizeof(int) * n);
+    memmove(&b->rlens[dst], &b->rlens[src], sizeof(int) * n);
+    memmove(&b->hs_in[dst], &b->hs_in[src], sizeof(uint32_t) * n);
+    memmove(&b->hs_out[dst], &b->hs_out[src], sizeof(uint32_t) * n);
+    memmove(&b->flags[dst], &b->flags[src], n);
+    memmove(&b->stamps[dst], &b->stamps[src], sizeof(uint32_t) * n);
+}
+
+/**
+ * @brief 给一行分配新的行戳，使其渲染行缓存失效
+ * @param b 缓冲区
+ * @param i 行号
+ * @note 行戳在所有缓冲区间唯一，`0`保留给空槽。
+ * 计数器不属于`ec`且原子递增，各线程处理各自的缓冲区时仍可调用。
+ */
+void editor_row_stamp(ebuf_t *b, int i) {
+    uint32_t s = __atomic_add_fetch(&row_stamp, 1, __ATOMIC_RELAXED);
+    if (s == 0) s = __atomic_add_fetch(&row_stamp, 1, __ATOMIC_RELAXED);
+    b->stamps[i] = s;
+}
+
+/**
+ * @brief 把行的长度同步到元数据数组
+ * @param b 缓冲区
+ * @param row 编辑器行
+ */
+void editor_row_sync_meta(ebuf_t *b, erow_t *row) {
+    b->lens[row->idx] = row->len;
+    b->rlens[row->idx] = row->rlen;
+    editor_row_stamp(b, row->idx);
+}
+
+/**
+ * @brief 编辑器（更新）渲染行
+ * @param b 缓冲区
+ * @param row 编辑器行
+ * @note 控制字符在绘制时才替换，`render`只展开制表符；
+ * 没有制表符时`render`直接指向`c`。
+ * 纯 ASCII 且无制表符的行（最常见的情况）跳过逐字节解码，不建列索引。
+ */
+void editor_update_row(ebuf_t *b, erow_t *row) {
+    b->version++;
+    int ascii = is_ascii(row->c, row->len);
+    int tabs = 0;
+    int n = 0;
+    ecol_t *cols = NULL;
+    if (!ascii || memchr(row->c, '\t', row->len)) {
+        // 逐字符解码，记录不规则字符
+        cols = editor_col_scratch(row->len);
+        int bx = 0, rx = 0;
+        int j = 0;
+        while (j < row->len) {
+            unsigned char ch = row->c[j];
+            int cn = 1, w = 1, kind;
+            if (ch == '\t') {
+                kind = COL_TAB;
+                w = TAB_STOP - rx % TAB_STOP;
+                tabs++;
+            } else if (ch < 0x80) {
+                j++; bx++; rx++;
+                continue;
+            } else {
+                int cp = utf8_decode(&row->c[j], row->len - j, &cn);
+                if (cp < 0xA0) {
+                    kind = COL_BAD;
+                } else {
+                    kind = COL_UTF8;
+                    w = char_width(cp);
+                }
+            }
+            ecol_t *e = &cols[n++];
+            e->cx = j;
+            e->bx = bx;
+            e->rx = rx;
+            e->kind = kind;
+            e->n = cn;
+            e->w = w;
+            j += cn;
+            bx += (kind == COL_TAB) ? w : cn;
+            rx += w;
+        }
+    }
+
+    row->num_cols = n;
+    if (n == 0) {
+        pool_free(&b->pool, row->cols);
+        row->cols = NULL;
+    } else {
+        row->cols = pool_realloc(&b->pool, row->cols, n * sizeof(ecol_t));
+        memcpy(row->cols, cols, n * sizeof(ecol_t));
+    }
+
+    if (!row->render_alias && !row->inl_r) pool_free(&b->pool, row->render);
+    row->render_alias = (tabs == 0);
+    row->inl_r = 0;
+    if (row->render_alias) {
+        row->render = row->c;
+        row->rlen = row->len;
+        editor_row_sync_meta(b, row);
+        editor_hl_edit(b, row);
+        return;
+    }
+    int size = row->len + tabs*(TAB_STOP - 1) + 1;
+    if (row->inl_c && row->len + 1 + size <= ROW_INLINE) {
+        row->render = row->inl + row->len + 1;
+        row->inl_r = 1;
+    } else {
+        row->render = pool_alloc(&b->pool, size);
+    }
+
+    // 制表符展开为空格，其余字节原样复制
+    int idx = 0, j = 0;
+    for (int k = 0; k < n; k++) {
+        if (cols[k].kind != COL_TAB) continue;
+        memcpy(&row->render[idx], &row->c[j], cols[k].cx - j);
+        idx += cols[k].cx - j;
+        memset(&row->render[idx], ' ', cols[k].w);
+        idx += cols[k].w;
+        j = cols[k].cx + 1;
+    }
+    memcpy(&row->render[idx], &row->c[j], row->len - j);
+    idx += row->len - j;
+    row->render[idx] = '\0';
+    row->rlen = idx;
+    editor_row_sync_meta(b, row);
+    editor_hl_edit(b, row);
 }
 
 /**
- * @brief 编辑器语法转颜色
- * @param hl 语法枚举，参考`dfitor_highlight`
- * @return int 颜色
+ * @brief 查找驻留文本
+ * @param b 缓冲区
+ * @param s 行字符串
+ * @param len 行长度
+ * @param hash 内容哈希
+ * @return etext_t* 内容相同的文本块，`NULL`表示不存在
  */
-int editor_syn2col(int hl) {
-    switch (hl) {
-        case HL_NUMBER   :  return 31;       // red
-        case HL_MLCOMMENT:
-        case HL_COMMENT  :  return 32;       // green
-        case HL_STRING   :  return 33;       // yellow
-        case HL_MATCH    :  return 34;       // blue
-        case HL_KEYWORD1 :  return 35;       // pink 
-        case HL_KEYWORD2 :  return 36;       // cyan
-        default: return 37;
-    }
+etext_t *editor_text_find(ebuf_t *b, const char *s, int len, uint64_t hash) {
+    if (b->texts_cap == 0) return NULL;
+    etext_t *t = b->texts[hash & (b->texts_cap - 1)];
+    for (; t; t = t->chain)
+        if (t->hash == hash && t->len == len && memcmp(t->c, s, len) == 0)
+            return t;
+    return NULL;
 }
 
 /**
- * @brief 编辑器匹配文件名的语法高亮
+ * @brief 把文本块加入驻留表，块数超过桶数时扩容一倍
+ * @param b 缓冲区
+ * @param t 文本块
  */
-void editor_select_syntax_highlight() {
-    ec.syntax = NULL;
-    if (ec.filename == NULL)
-        return;
-    char *ext = strrchr(ec.filename, '.');
-    for (unsigned int j = 0; j < HLDB_ENTRIES; j++) {
-        esyn_t *s = &HLDB[j];
-        unsigned int i = 0;
-        while (s->filematch[i]) {
-            int is_ext = (s->filematch[i][0] == '.');
-            if ((is_ext && ext && !strcmp(ext, s->filematch[i])) ||
-                (!is_ext && strstr(ec.filename, s->filematch[i]))) {
-                ec.syntax = s;
-                int filerow;
-                for (filerow = 0; filerow < ec.num_rows; filerow++) {
-                    editor_update_syntax(&ec.row[filerow]);
-                }
-                return;
+void editor_text_add(ebuf_t *b, etext_t *t) {
+    if (b->num_texts >= b->texts_cap) {
+        int cap = b->texts_cap ? 2 * b->texts_cap : 1024;
+        etext_t **texts = calloc(cap, sizeof(etext_t *));
+        if (texts == NULL) fatal("calloc");
+        for (int i = 0; i < b->texts_cap; i++) {
+            etext_t *e = b->texts[i];
+            while (e) {
+                etext_t *next = e->chain;
+                e->chain = texts[e->hash & (cap - 1)];
+                texts[e->hash & (cap - 1)] = e;
+                e = next;
             }
-            i++;
         }
+        free(b->texts);
+        b->texts = texts;
+        b->texts_cap = cap;
     }
+    etext_t **head = &b->texts[t->hash & (b->texts_cap - 1)];
+    t->chain = *head;
+    *head = t;
+    b->num_texts++;
 }
 
-
-// ======================================================================= //
-//                            Row Operations
-// ======================================================================= //
-
 /**
- * @brief 将字符索引转换为渲染索引
- * @param row 编辑器行
- * @param cx 字符索引
- * @return int 渲染索引
+ * @brief 释放一行对驻留文本的引用，最后一个引用释放时归还文本块
+ * @param b 缓冲区
+ * @param t 文本块
  */
-int editor_row_cx2rx(erow_t *row, int cx) {
-    int rx = 0;
-    int j;
-    for(j = 0; j < cx; j++) {
-        if(row->c[j] == '\t')
-            rx += (TAB_STOP - 1) - (rx % TAB_STOP);
-        rx++;
-    }
-    return rx;
+void editor_text_release(ebuf_t *b, etext_t *t) {
+    if (--t->refs > 0) return;
+    etext_t **p = &b->texts[t->hash & (b->texts_cap - 1)];
+    while (*p != t) p = &(*p)->chain;
+    *p = t->chain;
+    b->num_texts--;
+    if (!t->render_alias) pool_free(&b->pool, t->render);
+    pool_free(&b->pool, t->cols);
+    pool_free(&b->pool, t);
 }
 
 /**
- * @brief 将渲染索引转换为字符索引
- * @param row 编辑器行
- * @param rx 渲染索引
- * @return int 字符索引
+ * @brief 以驻留文本填充新行：内容相同的文本块已存在时共享，否则新建
+ * @param b 缓冲区
+ * @param row 编辑器行：除文本外的字段已初始化
+ * @param s 行字符串
+ * @param len 行长度
  */
-int editor_row_rx2cx(erow_t *row, int rx) {
-    int cur_rx = 0;
-    int cx;
-    for(cx = 0; cx < row->len; cx++) {
-        if(row->c[cx] == '\t')
-            cur_rx += (TAB_STOP - 1) - (cur_rx % TAB_STOP);
-        cur_rx++;
-        if(cur_rx > rx) return cx;
+void editor_row_intern(ebuf_t *b, erow_t *row, char *s, int len) {
+    uint64_t hash = hash_bytes(s, len);
+    etext_t *t = editor_text_find(b, s, len, hash);
+    if (t == NULL) {
+        t = pool_alloc(&b->pool, sizeof(etext_t) + len + 1);
+        t->hash = hash;
+        t->refs = 0;
+        t->len = len;
+        memcpy(t->c, s, len);
+        t->c[len] = '\0';
+        row->c = t->c;
+        row->len = len;
+        editor_update_row(b, row);
+        t->render = row->render;
+        t->rlen = row->rlen;
+        t->render_alias = row->render_alias;
+        t->cols = row->cols;
+        t->num_cols = row->num_cols;
+        editor_text_add(b, t);
     }
-    return cx;
+    t->refs++;
+    row->text = t;
+    row->c = t->c;
+    row->len = t->len;
+    row->render = t->render;
+    row->rlen = t->rlen;
+    row->render_alias = t->render_alias;
+    row->cols = t->cols;
+    row->num_cols = t->num_cols;
+    editor_row_sync_meta(b, row);
 }
 
 /**
- * @brief 编辑器（更新）渲染行
+ * @brief 写时复制：修改驻留行之前把借用的文本复制为私有
+ * @param b 缓冲区
  * @param row 编辑器行
  */
-void editor_update_row(erow_t *row) {
-    int tabs = 0;
-    int j;
-    for(j = 0; j < row->len; j++) {
-        if(row->c[j] == '\t') tabs++;
+void editor_row_own(ebuf_t *b, erow_t *row) {
+    etext_t *t = row->text;
+    if (t == NULL) return;
+    row->inl_c = t->len < ROW_INLINE;
+    row->c = row->inl_c ? row->inl : pool_alloc(&b->pool, t->len + 1);
+    memcpy(row->c, t->c, t->len + 1);
+    if (t->render_alias) {
+        row->render = row->c;
+    } else {
+        row->render = pool_alloc(&b->pool, t->rlen + 1);
+        memcpy(row->render, t->render, t->rlen + 1);
     }
-
-    free(row->render);
-    row->render = malloc(row->len + tabs*(TAB_STOP - 1) + 1);
-
-    int idx = 0;
-    for(j = 0; j < row->len; j++) {
-        if(row->c[j] == '\t') {
-            row->render[idx++] = ' ';
-            while(idx % TAB_STOP != 0) row->render[idx++] = ' ';
-        }else{
-            row->render[idx++] = row->c[j];
-        }
+    if (t->num_cols) {
+        row->cols = pool_alloc(&b->pool, t->num_cols * sizeof(ecol_t));
+        memcpy(row->cols, t->cols, t->num_cols * sizeof(ecol_t));
     }
-    row->render[idx] = '\0';
-    row->rlen = idx;
-    editor_update_syntax(row);
+    row->text = NULL;
+    editor_text_release(b, t);
 }
 
 /**
  * @brief 编辑器加入行
+ * @param b 缓冲区
  * @param at 行号
  * @param s 行字符串
  * @param len 行长度
  */
-void editor_insert_row(int at, char *s, size_t len) {
-    if(at < 0 || at > ec.num_rows) return;
-    ec.row = realloc(ec.row, sizeof(erow_t) * (ec.num_rows + 1));
-    memmove(&ec.row[at + 1], &ec.row[at], sizeof(erow_t) * (ec.num_rows - at));
-    for (int j = at + 1; j <= ec.num_rows; j++) ec.row[j].idx++;
+void editor_insert_row(ebuf_t *b, int at, char *s, size_t len) {
+    if(at < 0 || at > b->num_rows) return;
+    b->version++;
+    int from = at + 1;
+    if (b->num_rows == b->row_cap) {
+        // 按倍数扩容，移动后所有行的内联指针都要修正
+        b->row_cap = b->row_cap ? 2 * b->row_cap : 64;
+        b->row = realloc(b->row, sizeof(erow_t) * b->row_cap);
+        if (b->row == NULL) fatal("realloc");
+        editor_meta_resize(b);
+        from = 0;
+    }
+    memmove(&b->row[at + 1], &b->row[at], sizeof(erow_t) * (b->num_rows - at));
+    editor_meta_move(b, at + 1, at, b->num_rows - at);
+    for (int j = from; j <= b->num_rows; j++) {
+        if (j > at) b->row[j].idx++;
+        if (j != at) editor_row_rebase(&b->row[j]);
+    }
 
-    ec.row[at].idx = at;
-    ec.row[at].len = len;
-    ec.row[at].c = malloc(len + 1);
-    memcpy(ec.row[at].c, s, len);
-    ec.row[at].c[len] = '\0';
-    ec.row[at].rlen = 0;
-    ec.row[at].render = NULL;
-    ec.row[at].hl = NULL;
-    ec.row[at].hl_open_comment = 0;
-    editor_update_row(&ec.row[at]);
+    b->row[at].idx = at;
+    b->row[at].len = len;
+    b->row[at].c = NULL;
+    b->row[at].rlen = 0;
+    b->row[at].render = NULL;
+    b->row[at].render_alias = 0;
+    b->row[at].inl_c = b->row[at].inl_r = 0;
+    b->row[at].text = NULL;
+    b->row[at].cols = NULL;
+    b->row[at].num_cols = 0;
+    b->row[at].hl = NULL;
+    b->row[at].num_hl = 0;
+    b->hs_in[at] = b->hs_out[at] = HS_NORMAL;
+    b->flags[at] = 0;
+    editor_hl_truncate(b, at);
+    if (b->intern) {
+        editor_row_intern(b, &b->row[at], s, len);
+    } else {
+        b->row[at].inl_c = len < ROW_INLINE;
+        b->row[at].c = b->row[at].inl_c ? b->row[at].inl : pool_alloc(&b->pool, len + 1);
+        memcpy(b->row[at].c, s, len);
+        b->row[at].c[len] = '\0';
+        editor_update_row(b, &b->row[at]);
+    }
 
-    ec.num_rows++;
-    ec.dirty++;
+    b->num_rows++;
+    b->dirty++;
 }
 
 /**
  * @brief 编辑器释放行
+ * @param b 缓冲区
  * @param row 编辑器行
  */
-void editor_free_row(erow_t *row) {
-    free(row->render);
-    free(row->c);
-    free(row->hl);
+void editor_free_row(ebuf_t *b, erow_t *row) {
+    if (row->text) {
+        editor_text_release(b, row->text);
+    } else {
+        if (!row->render_alias && !row->inl_r) pool_free(&b->pool, row->render);
+        if (!row->inl_c) pool_free(&b->pool, row->c);
+        pool_free(&b->pool, row->cols);
+    }
+    editor_row_drop_hl(b, row);
 }
 
 /**
  * @brief 编辑器删除行
+ * @param b 缓冲区
  * @param at 行号
  */
-void editor_del_row(int at) {
-    if (at < 0 || at >= ec.num_rows)
+void editor_del_row(ebuf_t *b, int at) {
+    if (at < 0 || at >= b->num_rows)
         return;
-    editor_free_row(&ec.row[at]);
-    memmove(&ec.row[at], &ec.row[at + 1], sizeof(erow_t) * (ec.num_rows - at - 1));
-    for (int j = at; j < ec.num_rows - 1; j++) ec.row[j].idx--;
-    ec.num_rows--;
-    ec.dirty++;
+    b->version++;
+    editor_free_row(b, &b->row[at]);
+    memmove(&b->row[at], &b->row[at + 1], sizeof(erow_t) * (b->num_rows - at - 1));
+    editor_meta_move(b, at, at + 1, b->num_rows - at - 1);
+    for (int j = at; j < b->num_rows - 1; j++) {
+        b->row[j].idx--;
+        editor_row_rebase(&b->row[j]);
+    }
+    editor_hl_truncate(b, at);
+    b->num_rows--;
+    b->dirty++;
 }
 
 /**
  * @brief 在给定位置插入单个字符到`erow`
+ * @param b 缓冲区
  * @param row 编辑器行
  * @param at 字符索引
  * @param c 字符
  */
-void editor_row_insert_char(erow_t *row, int at, int c) {
+void editor_row_insert_char(ebuf_t *b, erow_t *row, int at, int c) {
     if (at < 0 || at > row->len)
         at = row->len;
-    row->c = realloc(row->c, row->len + 2);
+    editor_row_own(b, row);
+    editor_row_reserve(b, row, row->len + 2);
     memmove(&row->c[at + 1], &row->c[at], row->len - at + 1);
     row->len++;
     row->c[at] = c;
-    editor_update_row(row);
-    ec.dirty++;
+    editor_update_row(b, row);
+    b->dirty++;
 }
 
 /**
  * @brief 编辑器行加入字符串
+ * @param b 缓冲区
  * @param row 编辑器行
  * @param s 字符串
  * @param len 字符串长度
  * @note 用于实现删除功能
  */
-void editor_row_append_str(erow_t *row, char *s, size_t len) {
-    row->c = realloc(row->c, row->len + len + 1);
+void editor_row_append_str(ebuf_t *b, erow_t *row, char *s, size_t len) {
+    editor_row_own(b, row);
+    editor_row_reserve(b, row, row->len + len + 1);
     memcpy(&row->c[row->len], s, len);
     row->len += len;
     row->c[row->len] = '\0';
-    editor_update_row(row);
-    ec.dirty++;
+    editor_update_row(b, row);
+    b->dirty++;
 }
 
 
-void editor_row_del_char(erow_t *row, int at) {
+/**
+ * @brief 删除行内位于`at`的字符（多字节字符整体删除）
+ * @param b 缓冲区
+ * @param row 编辑器行
+ * @param at 字符索引
+ */
+void editor_row_del_char(ebuf_t *b, erow_t *row, int at) {
     if (at < 0 || at >= row->len)
         return;
-    memmove(&row->c[at], &row->c[at + 1], row->len - at);
-    row->len--;
-    editor_update_row(row);
-    ec.dirty++;
+    editor_row_own(b, row);
+    int n = editor_row_next_char(row, at) - at;
+    memmove(&row->c[at], &row->c[at + n], row->len - at - n + 1);
+    row->len -= n;
+    editor_update_row(b, row);
+    b->dirty++;
 }
 
 
@@ -772,46 +3516,55 @@ void editor_row_del_char(erow_t *row, int at) {
  * @param c 字符
  */
 void editor_insert_char(int c) {
-    if(ec.cursor_y == ec.num_rows) {
-        editor_insert_row(ec.num_rows, "", 0);
+    ebuf_t *b = ec.win->buf;
+    if(ec.win->cursor_y == b->num_rows) {
+        editor_insert_row(b, b->num_rows, "", 0);
     }
-    editor_row_insert_char(&ec.row[ec.cursor_y], ec.cursor_x, c);
-    ec.cursor_x++;
+    editor_row_insert_char(b, &b->row[ec.win->cursor_y], ec.win->cursor_x, c);
+    ec.win->cursor_x++;
 }
 
 /**
  * @brief 编辑器插入新行
  */
 void editor_insert_newline() {
-    if(ec.cursor_x == 0) {
-        editor_insert_row(ec.cursor_y, "", 0);
+    ebuf_t *b = ec.win->buf;
+    if(ec.win->cursor_x == 0) {
+        editor_insert_row(b, ec.win->cursor_y, "", 0);
     }else {
-        erow_t * row = &ec.row[ec.cursor_y];
-        editor_insert_row(ec.cursor_y + 1, &row->c[ec.cursor_x], row->len - ec.cursor_x);
-        row = &ec.row[ec.cursor_y];
-        row->len = ec.cursor_x;
+        erow_t * row = &b->row[ec.win->cursor_y];
+        char tail[ROW_INLINE];
+        char *s = &row->c[ec.win->cursor_x];
+        int len = row->len - ec.win->cursor_x;
+        // 内联存储会随行记录一起移动，先复制出来
+        if (row->inl_c) s = memcpy(tail, s, len);
+        editor_insert_row(b, ec.win->cursor_y + 1, s, len);
+        row = &b->row[ec.win->cursor_y];
+        editor_row_own(b, row);
+        row->len = ec.win->cursor_x;
         row->c[row->len] = '\0';
-        editor_update_row(row);
+        editor_update_row(b, row);
     }
-    ec.cursor_y++;
-    ec.cursor_x = 0;
+    ec.win->cursor_y++;
+    ec.win->cursor_x = 0;
 }
 
 /**
  * @brief 编辑器删除字符
  */
 void editor_del_char() {
-    if(ec.cursor_y == ec.num_rows) return;
-    if(ec.cursor_x == 0 && ec.cursor_y == 0) return;
-    erow_t *row = &ec.row[ec.cursor_y];
-    if(ec.cursor_x > 0) {
-        editor_row_del_char(row, ec.cursor_x - 1);
-        ec.cursor_x--;
+    ebuf_t *b = ec.win->buf;
+    if(ec.win->cursor_y == b->num_rows) return;
+    if(ec.win->cursor_x == 0 && ec.win->cursor_y == 0) return;
+    erow_t *row = &b->row[ec.win->cursor_y];
+    if(ec.win->cursor_x > 0) {
+        ec.win->cursor_x = editor_row_prev_char(row, ec.win->cursor_x);
+        editor_row_del_char(b, row, ec.win->cursor_x);
     } else {
-        ec.cursor_x = ec.row[ec.cursor_y - 1].len;
-        editor_row_append_str(&ec.row[ec.cursor_y - 1], row->c, row->len);
-        editor_del_row(ec.cursor_y);
-        ec.cursor_y--;
+        ec.win->cursor_x = b->row[ec.win->cursor_y - 1].len;
+        editor_row_append_str(b, &b->row[ec.win->cursor_y - 1], row->c, row->len);
+        editor_del_row(b, ec.win->cursor_y);
+        ec.win->cursor_y--;
     }
 }
 
@@ -821,21 +3574,22 @@ void editor_del_char() {
 
 /**
  * @brief 编辑器行转化为字符串
+ * @param b 缓冲区
  * @param str_len 获取字符串长度
  * @return char* 字符串指针
  */
-char* editor_rows2str(int *str_len) {
+char* editor_rows2str(ebuf_t *b, int *str_len) {
     int buf_len = 0;
     int j;
-    for(j = 0; j < ec.num_rows; j++)
-        buf_len += ec.row[j].len + 1;
+    for(j = 0; j < b->num_rows; j++)
+        buf_len += b->lens[j] + 1;
     *str_len = buf_len;
 
     char *str = malloc(buf_len);
     char *p = str;
-    for(j = 0; j < ec.num_rows; j++) {
-        memcpy(p, ec.row[j].c, ec.row[j].len);
-        p += ec.row[j].len;
+    for(j = 0; j < b->num_rows; j++) {
+        memcpy(p, b->row[j].c, b->row[j].len);
+        p += b->row[j].len;
         *p = '\n';
         p++;
     }
@@ -843,16 +3597,66 @@ char* editor_rows2str(int *str_len) {
 }
 
 /**
- * @brief 编辑器打开文件
+ * @brief 新建空缓冲区
+ * @return ebuf_t* 缓冲区
+ * @note 设置了环境变量`TEXC_INTERN`时开启行驻留：内容相同的行共享同一文本块，
+ * 适合日志、CSV 等大量重复行的文件。
+ */
+ebuf_t *editor_buf_new() {
+    ebuf_t *b = calloc(1, sizeof(ebuf_t));
+    if (b == NULL) fatal("calloc");
+    b->intern = getenv("TEXC_INTERN") != NULL;
+    return b;
+}
+
+/**
+ * @brief 关闭缓冲区中的文件：整体释放行存储池
+ * @param b 缓冲区
+ */
+void editor_buf_close(ebuf_t *b) {
+    free(b->row);
+    free(b->lens);
+    free(b->rlens);
+    free(b->hs_in);
+    free(b->hs_out);
+    free(b->flags);
+    free(b->stamps);
+    b->lens = b->rlens = NULL;
+    b->hs_in = b->hs_out = NULL;
+    b->flags = NULL;
+    b->stamps = NULL;
+    b->row_cap = 0;
+    pool_destroy(&b->pool);
+    free(b->texts);
+    b->texts = NULL;
+    b->texts_cap = b->num_texts = 0;
+    free(b->filename);
+    b->row = NULL;
+    b->filename = NULL;
+    b->num_rows = 0;
+    b->dirty = 0;
+    b->version++;
+    editor_hl_truncate(b, 0);
+}
+
+/**
+ * @brief 将文件读入缓冲区
+ * @param b 缓冲区
  * @param filename 文件名
+ * @return int 返回值
+ * @retval -1 打开失败，`errno`指示原因
+ * @retval 0  读取成功
+ * @note 先关闭缓冲区中原有的文件，因此也可用于重新载入。
  */
-void editor_open(char *filename) {
-    free(ec.filename);
-    ec.filename = strdup(filename);
+int editor_buf_open(ebuf_t *b, char *filename) {
+    TRACE_SCOPE("editor_open");
     FILE *fp = fopen(filename, "r");
-    if (!fp) fatal("fopen");
+    if (!fp) return -1;
+    char *name = strdup(filename);
+    editor_buf_close(b);
+    b->filename = name;
 
-    editor_select_syntax_highlight();
+    editor_select_syntax_highlight(b);
 
     char *line = NULL;
     size_t line_cap = 0;
@@ -861,49 +3665,332 @@ void editor_open(char *filename) {
         while (line_len > 0 && (line[line_len - 1] == '\n' ||
                                 line[line_len - 1] == '\r'))
             line_len--;
-        editor_insert_row(ec.num_rows, line, line_len);
+        editor_insert_row(b, b->num_rows, line, line_len);
     }
     free(line);
     fclose(fp);
-    ec.dirty = 0;
+    b->dirty = 0;
+    return 0;
 }
 
 /**
- * @brief 编辑器保存
+ * @brief 将缓冲区写入其文件
+ * @param b 缓冲区
+ * @return int 写入的字节数，`-1`表示失败，`errno`指示原因
  */
-void editor_save() {
-    if(ec.filename == NULL) {
-        ec.filename = editor_prompt("Save as: %s (ESC to cancel)", NULL);
-        if (ec.filename == NULL) {
-            editor_set_status_msg("Save aborted");
-            return;
-        }
-        editor_select_syntax_highlight();
-    }
-
+int editor_buf_write(ebuf_t *b) {
+    TRACE_SCOPE("editor_save");
     int len;
-    char *buf = editor_rows2str(&len);
-    int fd = open(ec.filename, O_RDWR | O_CREAT, 0644);
+    char *buf = editor_rows2str(b, &len);
+    int fd = open(b->filename, O_RDWR | O_CREAT, 0644);
     if(fd != -1) {
         if(ftruncate(fd, len) != -1) {
             if(write(fd, buf, len) == len) {
                 close(fd);
                 free(buf);
-                ec.dirty = 0;
-                editor_set_status_msg("%d bytes written to disk", len);
-                return;
+                b->dirty = 0;
+                return len;
             } // if write
         } // if ftruncate
+        int err = errno;
         close(fd);
+        errno = err;
     } // if fd
     free(buf);
-    editor_set_status_msg("Can't save I/O error: %s", strerror(errno));
+    return -1;
+}
+
+/**
+ * @brief 编辑器打开文件
+ * @param filename 文件名
+ */
+void editor_open(char *filename) {
+    if (editor_buf_open(ec.win->buf, filename) == -1) fatal("fopen");
+    ec.win->cursor_x = ec.win->cursor_y = 0;
+    ec.win->row_off = ec.win->clo_off = 0;
+    for (int o = 0; o < OV_NUM; o++) ec.overlay[o].row = -1;
+}
+
+/**
+ * @brief 编辑器保存
+ */
+void editor_save() {
+    if(ec.win->buf->filename == NULL) {
+        ec.win->buf->filename = editor_prompt("Save as: %s (ESC to cancel)", NULL);
+        if (ec.win->buf->filename == NULL) {
+            editor_set_status_msg("Save aborted");
+            return;
+        }
+        editor_select_syntax_highlight(ec.win->buf);
+    }
+    int len = editor_buf_write(ec.win->buf);
+    if (len != -1)
+        editor_set_status_msg("%d bytes written to disk", len);
+    else
+        editor_set_status_msg("Can't save I/O error: %s", strerror(errno));
+}
+
+// ======================================================================= //
+//                                Buffers
+// ======================================================================= //
+
+/**
+ * @brief 将缓冲区加入缓冲区列表
+ * @param b 缓冲区
+ * @return int 缓冲区下标
+ */
+int editor_buf_add(ebuf_t *b) {
+    ec.bufs = realloc(ec.bufs, sizeof(ebuf_t *) * (ec.num_bufs + 1));
+    if (ec.bufs == NULL) fatal("realloc");
+    ec.bufs[ec.num_bufs] = b;
+    return ec.num_bufs++;
+}
+
+/**
+ * @brief 查找缓冲区的下标
+ * @param b 缓冲区
+ * @return int 在`ec.bufs`中的下标
+ * @note 各窗口可以显示不同的缓冲区，下标总是由窗口的缓冲区推出，不单独保存。
+ */
+int editor_buf_index(ebuf_t *b) {
+    for (int i = 0; i < ec.num_bufs; i++)
+        if (ec.bufs[i] == b) return i;
+    return 0;
+}
+
+/**
+ * @brief 切换到另一个缓冲区
+ * @param idx 缓冲区下标，越界时回绕
+ * @note 仅交换光标与偏移量：各缓冲区的行、渲染结果与高亮保持不变，
+ * 不会重新读取或重新高亮；语法表`HLDB`本身只读，由所有缓冲区共享。
+ */
+void editor_buf_switch(int idx) {
+    if (ec.num_bufs == 0) return;
+    idx = (idx % ec.num_bufs + ec.num_bufs) % ec.num_bufs;
+    ebuf_t *b = ec.win->buf;
+    b->cursor_x = ec.win->cursor_x;
+    b->cursor_y = ec.win->cursor_y;
+    b->row_off  = ec.win->row_off;
+    b->clo_off  = ec.win->clo_off;
+
+    ec.win->buf = b = ec.bufs[idx];
+    ec.win->cursor_x = b->cursor_x;
+    ec.win->cursor_y = b->cursor_y;
+    ec.win->row_off  = b->row_off;
+    ec.win->clo_off  = b->clo_off;
+    for (int o = 0; o < OV_NUM; o++) ec.overlay[o].row = -1;
+    editor_set_status_msg("[%d/%d] %s", idx + 1, ec.num_bufs,
+        b->filename ? b->filename : "[No Name]");
+}
+
+/**
+ * @brief 是否有缓冲区未保存
+ * @return int 布尔
+ */
+int editor_bufs_dirty() {
+    for (int i = 0; i < ec.num_bufs; i++)
+        if (ec.bufs[i]->dirty) return 1;
+    return 0;
+}
+
+// ======================================================================= //
+//                                Windows
+// ======================================================================= //
+
+/**
+ * @brief 新建窗口
+ * @param b 窗口显示的缓冲区
+ * @return ewin_t* 窗口，光标与偏移量为`0`
+ */
+ewin_t *editor_win_new(ebuf_t *b) {
+    ewin_t *w = calloc(1, sizeof(ewin_t));
+    if (w == NULL) fatal("calloc");
+    w->buf = b;
+    return w;
+}
+
+/**
+ * @brief 新建布局树的叶子节点
+ * @param w 窗口
+ * @return esplit_t* 节点
+ */
+esplit_t *editor_split_new(ewin_t *w) {
+    esplit_t *n = calloc(1, sizeof(esplit_t));
+    if (n == NULL) fatal("calloc");
+    n->win = w;
+    return n;
+}
+
+/**
+ * @brief 在布局树中查找窗口所在的叶子节点
+ * @param n 子树根节点
+ * @param w 窗口
+ * @return esplit_t* 叶子节点，未找到时为`NULL`
+ */
+esplit_t *editor_split_find(esplit_t *n, ewin_t *w) {
+    if (n->dir == SPLIT_NONE) return n->win == w ? n : NULL;
+    esplit_t *r = editor_split_find(n->a, w);
+    return r ? r : editor_split_find(n->b, w);
+}
+
+/**
+ * @brief 按先序收集子树中的窗口到`ec.wins`
+ * @param n 子树根节点
+ */
+void editor_win_collect(esplit_t *n) {
+    if (n->dir != SPLIT_NONE) {
+        editor_win_collect(n->a);
+        editor_win_collect(n->b);
+        return;
+    }
+    ec.wins = realloc(ec.wins, sizeof(ewin_t *) * (ec.num_wins + 1));
+    if (ec.wins == NULL) fatal("realloc");
+    ec.wins[ec.num_wins++] = n->win;
+}
+
+/**
+ * @brief 重建窗口列表`ec.wins`
+ */
+void editor_win_list() {
+    ec.num_wins = 0;
+    editor_win_collect(ec.layout);
+}
+
+/**
+ * @brief 计算布局：把屏幕区域分配给各个窗口
+ * @param n 子树根节点
+ * @param top 区域顶行
+ * @param left 区域左列
+ * @param rows 区域行数，含状态栏
+ * @param cols 区域列数
+ * @note 上下分割平分行数；左右分割在两侧之间留一列分隔线。
+ */
+void editor_layout(esplit_t *n, int top, int left, int rows, int cols) {
+    n->top = top;
+    n->left = left;
+    n->rows = rows;
+    n->cols = cols;
+    if (n->dir == SPLIT_H) {
+        int ra = rows / 2;
+        editor_layout(n->a, top, left, ra, cols);
+        editor_layout(n->b, top + ra, left, rows - ra, cols);
+    } else if (n->dir == SPLIT_V) {
+        int ca = (cols - 1) / 2;
+        editor_layout(n->a, top, left, rows, ca);
+        editor_layout(n->b, top, left + ca + 1, rows, cols - ca - 1);
+    } else {
+        n->win->top = top;
+        n->win->left = left;
+        n->win->rows = rows - 1;
+        n->win->cols = cols;
+    }
+}
+
+/**
+ * @brief 分割当前窗口
+ * @param dir 分割方式：`SPLIT_H`或`SPLIT_V`
+ * @note 新窗口显示同一缓冲区，继承光标与偏移量；焦点留在原窗口。
+ */
+void editor_win_split(int dir) {
+    esplit_t *n = editor_split_find(ec.layout, ec.win);
+    if ((dir == SPLIT_H && n->rows < 4) || (dir == SPLIT_V && n->cols < 3)) {
+        editor_set_status_msg("Window too small to split");
+        return;
+    }
+    ewin_t *w = editor_win_new(ec.win->buf);
+    *w = *ec.win;
+    // 新窗口只沿用视图状态：渲染行缓存与屏幕上的内容都属于原窗口
+    w->lines = NULL;
+    w->num_lines = 0;
+    w->drawn = 0;
+    esplit_t *a = editor_split_new(ec.win);
+    esplit_t *b = editor_split_new(w);
+    a->parent = b->parent = n;
+    n->dir = dir;
+    n->win = NULL;
+    n->a = a;
+    n->b = b;
+    editor_win_list();
+}
+
+/**
+ * @brief 关闭当前窗口，由其兄弟节点占据空出的区域
+ * @note 缓冲区保持打开；最后一个窗口不能关闭。
+ */
+void editor_win_close() {
+    esplit_t *n = editor_split_find(ec.layout, ec.win);
+    esplit_t *p = n->parent;
+    if (p == NULL) {
+        editor_set_status_msg("Can't close the last window");
+        return;
+    }
+    esplit_t *sib = (p->a == n) ? p->b : p->a;
+    esplit_t *up = p->parent;
+    *p = *sib;
+    p->parent = up;
+    if (p->dir != SPLIT_NONE) p->a->parent = p->b->parent = p;
+    free(sib);
+    for (int i = 0; i < n->win->num_lines; i++) abuf_free(&n->win->lines[i].ab);
+    free(n->win->lines);
+    free(n->win);
+    free(n);
+    while (p->dir != SPLIT_NONE) p = p->a;
+    ec.win = p->win;
+    editor_win_list();
+}
+
+/**
+ * @brief 将焦点移到下一个窗口
+ */
+void editor_win_next() {
+    for (int i = 0; i < ec.num_wins; i++) {
+        if (ec.wins[i] == ec.win) {
+            ec.win = ec.wins[(i + 1) % ec.num_wins];
+            return;
+        }
+    }
 }
 
 // ======================================================================= //
 //                               Editor Find
 // ======================================================================= //
 
+/**
+ * @brief 在缓冲区中查找字符串
+ * @param b 缓冲区
+ * @param query 查询字符串
+ * @param from 起始行（不含），`-1`表示从头开始
+ * @param direction 方向：`1`向下，`-1`向上，到达边界后回绕
+ * @param off 输出：匹配在`render`中的字节偏移
+ * @return int 匹配所在行，`-1`表示未找到
+ */
+int editor_buf_find(ebuf_t *b, const char *query, int from, int direction, int *off) {
+    TRACE_SCOPE("editor_find");
+    int current = from;
+    int qlen = strlen(query);
+    int i;
+    for(i = 0; i < b->num_rows; i++) {
+        current += direction;
+        if(current == -1) {
+            current = b->num_rows - 1;
+        } else if(current == b->num_rows) {
+            current = 0;
+        }
+        // 先按长度筛掉放不下查询串的行，不必访问行记录与内容
+        if (b->rlens[current] < qlen) continue;
+        erow_t *row = &b->row[current];
+        // 短行的内容在行记录内，提前取后面的行记录，查找时不必等待内存
+        int ahead = current + 8 * direction;
+        if (ahead >= 0 && ahead < b->num_rows) __builtin_prefetch(&b->row[ahead]);
+        char *match = strstr(row->render, query);
+        if(match) {
+            *off = match - row->render;
+            return current;
+        }
+    }
+    return -1;
+}
+
 /**
  * @brief 编辑器查找回调函数
  * @param query 查询字符串
@@ -912,14 +3999,8 @@ void editor_save() {
 void editor_find_callback(char *query, int key) {
     static int last_match = -1;
     static int direction = 1;
-    static int saved_hl_line;
-    static char *saved_hl = NULL;
 
-    if(saved_hl) {
-        memcpy(ec.row[saved_hl_line].hl, saved_hl, ec.row[saved_hl_line].rlen);
-        free(saved_hl);
-        saved_hl = NULL;
-    }
+    ec.overlay[OV_MATCH].row = -1;
     if (key == '\r' || key == '\x1b') {
         last_match = -1;
         direction = 1;
@@ -933,29 +4014,17 @@ void editor_find_callback(char *query, int key) {
         direction = 1;
     }
     if (last_match == -1) direction = 1;
-    int current = last_match;
-    int i;
-    for(i = 0; i < ec.num_rows; i++) {
-        current += direction;
-        if(current == -1) {
-            current = ec.num_rows - 1;
-        } else if(current == ec.num_rows) {
-            current = 0;
-        }
-
-        erow_t *row = &ec.row[current];
-        char *match = strstr(row->render, query);
-        if(match) {
-            last_match = current;
-            ec.cursor_y = current;
-            ec.cursor_x = editor_row_rx2cx(row, match - row->render);
-            // ec.row_off = ec.num_rows;
-            saved_hl_line = current;
-            saved_hl = malloc(row->rlen);
-            memcpy(saved_hl, row->hl, row->rlen);
-            memset(&row->hl[match - row->render], HL_MATCH, strlen(query));
-            break;
-        }
+    int off;
+    int current = editor_buf_find(ec.win->buf, query, last_match, direction, &off);
+    if (current != -1) {
+        erow_t *row = &ec.win->buf->row[current];
+        last_match = current;
+        ec.win->cursor_y = current;
+        ec.win->cursor_x = editor_row_map(row, U_RENDER, U_CHARS, off);
+        ec.overlay[OV_MATCH].row = current;
+        ec.overlay[OV_MATCH].start = off;
+        ec.overlay[OV_MATCH].len = strlen(query);
+        ec.overlay[OV_MATCH].cls = HL_MATCH;
     }
 }
 
@@ -964,18 +4033,18 @@ void editor_find_callback(char *query, int key) {
  * @brief 编辑器寻找字符串
  */
 void editor_find() {
-    int saved_cx = ec.cursor_x;
-    int saved_cy = ec.cursor_y;
-    int saved_col_off = ec.clo_off;
-    int saved_row_off = ec.row_off;
+    int saved_cx = ec.win->cursor_x;
+    int saved_cy = ec.win->cursor_y;
+    int saved_col_off = ec.win->clo_off;
+    int saved_row_off = ec.win->row_off;
     char *query = editor_prompt("Search: %s (ESC to cancel)", editor_find_callback);
     if(query) {
         free(query);
     } else {
-        ec.cursor_x = saved_cx;
-        ec.cursor_y = saved_cy;
-        ec.clo_off = saved_col_off;
-        ec.row_off = saved_row_off;
+        ec.win->cursor_x = saved_cx;
+        ec.win->cursor_y = saved_cy;
+        ec.win->clo_off = saved_col_off;
+        ec.win->row_off = saved_row_off;
     }
 }
 
@@ -985,52 +4054,206 @@ void editor_find() {
 
 /**
  * @brief 编辑器滚动
- * @note 设置`ec.rowoff`值：
+ * @param w 窗口
+ * @note 设置`w->row_off`值：
  * 策略是检查光标是否已移出可见窗口，
- * 如果是，则调整`ec.rowoff`，
+ * 如果是，则调整`w->row_off`，
  * 使光标刚好位于可见窗口内。
  */
-void editor_scroll() {
-    ec.render_x = 0;
-    if(ec.cursor_y < ec.num_rows) {
-        ec.render_x = editor_row_cx2rx(&ec.row[ec.cursor_y], ec.cursor_x);
+void editor_scroll(ewin_t *w) {
+    w->render_x = 0;
+    if(w->cursor_y < w->buf->num_rows) {
+        w->render_x = editor_row_cx2rx(&w->buf->row[w->cursor_y], w->cursor_x);
+    }
+    if (w->cursor_y < w->row_off) {
+        w->row_off = w->cursor_y;
     }
-    if (ec.cursor_y < ec.row_off) {
-        ec.row_off = ec.cursor_y;
+    if(w->cursor_y >= w->row_off + w->rows) {
+        w->row_off = w->cursor_y - w->rows + 1;
     }
-    if(ec.cursor_y >= ec.row_off + ec.screen_rows) {
-        ec.row_off = ec.cursor_y - ec.screen_rows + 1;
+    if(w->render_x < w->clo_off) {
+        w->clo_off = w->render_x;
     }
-    if(ec.render_x < ec.clo_off) {
-        ec.clo_off = ec.render_x;
+    if(w->render_x >= w->clo_off + w->cols) {
+        w->clo_off = w->render_x - w->cols + 1;
+    }
+}
+
+/**
+ * @brief 追加光标定位序列`CSI y;x H`
+ * @param ab 追加缓冲区
+ * @param y 屏幕行（从`1`开始）
+ * @param x 屏幕列（从`1`开始）
+ * @note 每帧每行都要定位一次，手工转换数字，不走`snprintf`。
+ */
+void abuf_cup(abuf_t *ab, int y, int x) {
+    char buf[32], *p = buf + sizeof(buf);
+    *--p = 'H';
+    do { *--p = '0' + x % 10; x /= 10; } while (x);
+    *--p = ';';
+    do { *--p = '0' + y % 10; y /= 10; } while (y);
+    *--p = '[';
+    *--p = '\x1b';
+    abuf_append(ab, p, buf + sizeof(buf) - p);
+}
+
+/**
+ * @brief 编码一行的可见部分：SGR 序列与文本，不含行首定位与行尾擦除
+ * @param ab 追加缓冲区
+ * @param w 窗口
+ * @param file_row 文件行号
+ * @param ovs 落在本行的覆盖层，按位对应`ec.overlay`
+ * @note 结果只取决于行内容、高亮区间、覆盖层与窗口的列偏移和宽度，
+ * 因此没有覆盖层的行可以缓存，参考`editor_line_get`。
+ */
+void editor_encode_row(abuf_t *ab, ewin_t *w, int file_row, int ovs) {
+    // 可见列换算为渲染字节区间 [pos, end)
+    erow_t *row = &w->buf->row[file_row];
+    char *c = row->render;
+    int pos = editor_row_map(row, U_COLS, U_RENDER, w->clo_off);
+    int end = editor_row_map(row, U_COLS, U_RENDER, w->clo_off + w->cols);
+    if (pos > row->rlen) pos = row->rlen;
+    if (end > row->rlen) end = row->rlen;
+    int ci = editor_row_col_count(row, U_RENDER, pos - 1);
+    if (pos < end && ci < row->num_cols && row->cols[ci].bx == pos &&
+        row->cols[ci].rx < w->clo_off) {
+        // 宽字符被左边界截断：以空格补齐剩余的列
+        ecol_t *e = &row->cols[ci++];
+        for (int pad = e->rx + e->w - w->clo_off; pad > 0; pad--)
+            abuf_append(ab, " ", 1);
+        pos += e->n;
     }
-    if(ec.render_x >= ec.clo_off + ec.screen_cols) {
-        ec.clo_off = ec.render_x - ec.screen_cols + 1;
+    int k = editor_row_span_at(row, pos);
+    etheme_t *th = &ec.theme;
+    int current = HL_NORMAL;
+    while (pos < end) {
+        // 合并语法高亮区间与覆盖层，得到 [pos, next) 的类别
+        int cls = HL_NORMAL;
+        int next = end;
+        if (k < row->num_hl && row->hl[k].start <= pos) {
+            cls = row->hl[k].cls;
+            next = row->hl[k].start + row->hl[k].len;
+        } else if (k < row->num_hl) {
+            next = row->hl[k].start;
+        }
+        for (int o = 0; ovs && o < OV_NUM; o++) {
+            eoverlay_t *ov = &ec.overlay[o];
+            if (!(ovs & (1 << o))) continue;
+            if (ov->start <= pos && pos < ov->start + ov->len) {
+                cls = ov->cls;
+                if (ov->start + ov->len < next) next = ov->start + ov->len;
+            } else if (ov->start > pos && ov->start < next) {
+                next = ov->start;
+            }
+        }
+        if (next > end) next = end;
+        if (th->alias[cls] != current) {
+            current = th->alias[cls];
+            abuf_append(ab, th->sgr[current], th->len[current]);
+        }
+        // 整段输出，控制字符与非法字节反色显示：
+        // 可打印 ASCII 成批跳过，只有非 ASCII 字节才查列表
+        int j = pos;
+        while (j < next) {
+            int run = j;
+            int bad = 0;
+            while (run < next) {
+                run += scan_plain(&c[run], next - run);
+                if (run == next) break;
+                unsigned char ch = c[run];
+                if (ch >= 0x80) {
+                    while (ci < row->num_cols && row->cols[ci].bx < run) ci++;
+                    if (ci == row->num_cols || row->cols[ci].bx != run) {
+                        run++;
+                    } else if (row->cols[ci].kind == COL_BAD) {
+                        bad = row->cols[ci].n;
+                        break;
+                    } else {
+                        run += row->cols[ci].n;
+                    }
+                    continue;
+                }
+                bad = 1;
+                break;
+            }
+            if (run > j) abuf_append(ab, &c[j], run - j);
+            if (bad) {
+                char sym = ((unsigned char)c[run] <= 26) ? '@' + c[run] : '?';
+                abuf_append(ab, "\x1b[7m", 4);
+                abuf_append(ab, &sym, 1);
+                abuf_append(ab, "\x1b[m", 3);
+                if (current != HL_NORMAL)
+                    abuf_append(ab, th->sgr[current], th->len[current]);
+                run += bad;
+            }
+            j = run;
+        }
+        pos = j;
+        while (k < row->num_hl && row->hl[k].start + row->hl[k].len <= pos) k++;
     }
+    abuf_append(ab, "\x1b[39m", 5);
 }
 
+/**
+ * @brief 取窗口中一行编码好的字节，缓存失效时重新编码
+ * @param w 窗口
+ * @param file_row 文件行号
+ * @return eline_t* 缓存项
+ * @note 缓存按行戳直接映射，槽数为窗口行数两倍以上的 2 的幂。
+ * 行戳在行内容或高亮区间改变时取新值（参考`editor_row_stamp`），且全局唯一，
+ * 所以行戳、列偏移与宽度都相同的缓存项必然仍然有效：
+ * 编辑一行只需重新编码这一行，插入删除行或纵向滚动后其余各行仍能命中，
+ * 横向滚动与改变宽度则使所有缓存项失效。
+ */
+eline_t *editor_line_get(ewin_t *w, int file_row) {
+    if (w->num_lines < w->rows * 2) {
+        int n = w->num_lines ? w->num_lines : 64;
+        while (n < w->rows * 2) n *= 2;
+        w->lines = realloc(w->lines, sizeof(eline_t) * n);
+        if (w->lines == NULL) fatal("realloc");
+        memset(&w->lines[w->num_lines], 0, sizeof(eline_t) * (n - w->num_lines));
+        for (int i = 0; i < w->num_lines; i++) w->lines[i].stamp = 0;
+        w->num_lines = n;
+    }
+    uint32_t stamp = w->buf->stamps[file_row];
+    eline_t *e = &w->lines[stamp & (w->num_lines - 1)];
+    if (e->stamp != stamp || e->clo_off != w->clo_off || e->cols != w->cols) {
+        e->ab.len = 0;
+        editor_encode_row(&e->ab, w, file_row, 0);
+        e->stamp = stamp;
+        e->clo_off = w->clo_off;
+        e->cols = w->cols;
+    }
+    return e;
+}
 
 /**
  * @brief 编辑器绘制行
  * @param ab 追加缓冲区
+ * @param w 窗口
+ * @param lo 起始屏幕行（窗口内，从`0`开始）
+ * @param hi 结束屏幕行（不含）
  * @note 类似`vim`左侧的波浪。
- * - 我们打印最后一个波形符时，
- * 会像在任何其他行上一样打印“\r\n”，
- * 但这会导致终端滚动以便为新的空白行腾出空间。
- * 故打印“\r\n”时，需要让最后一行成为例外。
+ * 每行先定位到窗口左边界再绘制。到达屏幕右边缘的窗口最后擦除到行尾；
+ * 其他窗口先用`ECH`只擦除自己的列，以免只重绘部分窗口时波及右侧的窗口与分隔线。
  */
-void editor_draw_rows(abuf_t *ab) {
+void editor_draw_rows(abuf_t *ab, ewin_t *w, int lo, int hi) {
     int y;
-    for(y = 0; y < ec.screen_rows; y++) {
-        int file_row = y + ec.row_off;
-        if(file_row >= ec.num_rows) {
-            if(ec.num_rows == 0 && y == ec.screen_rows / 3) {
+    int edge = (w->left + w->cols >= ec.screen_cols);
+    char ech[16];
+    int ech_len = edge ? 0 : snprintf(ech, sizeof(ech), "\x1b[%dX", w->cols);
+    for(y = lo; y < hi; y++) {
+        int file_row = y + w->row_off;
+        abuf_cup(ab, w->top + y + 1, w->left + 1);
+        abuf_append(ab, ech, ech_len);
+        if(file_row >= w->buf->num_rows) {
+            if(w->buf->num_rows == 0 && y == w->rows / 3) {
                 // 如果新建文件：居中打印欢迎信息    
                 char welcome[80];
                 int welcome_len = snprintf(welcome, sizeof(welcome),
                     "texc editor %s", TEXC_VERSION);
-                if(welcome_len > ec.screen_cols) welcome_len = ec.screen_cols;
-                int padding = (ec.screen_cols - welcome_len) / 2;
+                if(welcome_len > w->cols) welcome_len = w->cols;
+                int padding = (w->cols - welcome_len) / 2;
                 if(padding) {
                     abuf_append(ab, "~", 1);
                     padding--;
@@ -1040,68 +4263,94 @@ void editor_draw_rows(abuf_t *ab) {
             } else {
                 // 打开旧文件：绘制`~`
                 abuf_append(ab, "~",  1);
-            } // if y >= ec.num_rows
+            } // if y >= w->buf->num_rows
         } else {
-            // 绘制文件内字符串
-            int len = ec.row[file_row].rlen - ec.clo_off;
-            if(len < 0) len = 0;
-            if(len > ec.screen_cols) len = ec.screen_cols;
-            char *c = &ec.row[file_row].render[ec.clo_off];
-            unsigned char *hl = &ec.row[file_row].hl[ec.clo_off];
-            int current_color = -1;
-            int j;
-            for(j = 0; j < len; j++) {
-                if (iscntrl(c[j])) {
-                    char sym = (c[j] <= 26) ? '@' + c[j] : '?';
-                    abuf_append(ab, "\x1b[7m", 4);
-                    abuf_append(ab, &sym, 1);
-                    abuf_append(ab, "\x1b[m", 3);
-                    if (current_color != -1) {
-                        char buf[16];
-                        int clen = snprintf(buf, sizeof(buf), "\x1b[%dm", current_color);
-                        abuf_append(ab, buf, clen);
-                    }
-                } else if (hl[j] == HL_NORMAL) {
-                    if(current_color != -1) {
-                        abuf_append(ab, "\x1b[39m", 5);
-                        current_color = -1;
-                    }
-                    abuf_append(ab, &c[j], 1);
-                } else {
-                    int color = editor_syn2col(hl[j]);
-                    if(color != current_color) {
-                        current_color = color;
-                        char buf[16];
-                        int clen = snprintf(buf, sizeof(buf), "\x1b[%dm", color);
-                        abuf_append(ab, buf, clen);
-                    }
-                    abuf_append(ab, &c[j], 1);
-                } // if isdigit
-            } // for j
-            abuf_append(ab, "\x1b[39m", 5);
+            // 覆盖层只属于当前窗口的缓冲区，先挑出落在本行的，多数行没有
+            int ovs = 0;
+            for (int o = 0; o < OV_NUM; o++)
+                if (ec.overlay[o].row == file_row && w->buf == ec.win->buf) ovs |= 1 << o;
+            eline_t *e = ovs ? NULL : editor_line_get(w, file_row);
+            if (e == NULL) {
+                editor_encode_row(ab, w, file_row, ovs);
+            } else {
+                abuf_append(ab, e->ab.b, e->ab.len);
+            }
         }
         // 擦除光标右侧部分
-        abuf_append(ab, "\x1b[K", 3);       
-        abuf_append(ab, "\r\n", 2);
+        if (edge) abuf_append(ab, "\x1b[K", 3);
     } // for y
 }
 
+/**
+ * @brief 编辑器绘制窗口的文本区：只重绘屏幕上已失效的部分
+ * @param ab 追加缓冲区
+ * @param w 窗口：已同步高亮
+ * @param full 布尔：强制整个重绘
+ * @return int 布尔：是否整个重绘
+ * @note 缓冲区内容、屏幕区域与列偏移都未变时：
+ * - 行偏移也未变（如只移动了光标）则不输出任何内容；
+ * - 行偏移改变少于一屏时，对占满屏幕宽度的窗口设置滚动区域（`DECSTBM`）
+ *   并用`CSI n S`/`CSI n T`滚动，只绘制新露出的行，输出字节数与滚动的行数成正比。
+ */
+int editor_draw_window(abuf_t *ab, ewin_t *w, int full) {
+    int same = w->drawn && w->drawn_buf == w->buf && w->drawn_version == w->buf->version &&
+               w->drawn_clo_off == w->clo_off && w->drawn_top == w->top &&
+               w->drawn_left == w->left && w->drawn_rows == w->rows && w->drawn_cols == w->cols;
+    int d = w->row_off - w->drawn_row_off;
+    if (!full && same && d == 0) {
+        return 0;
+    } else if (!full && same && abs(d) < w->rows &&
+               w->left == 0 && w->cols == ec.screen_cols) {
+        char buf[48];
+        int len = snprintf(buf, sizeof(buf), "\x1b[%d;%dr\x1b[%d%c\x1b[r",
+                           w->top + 1, w->top + w->rows, abs(d), d > 0 ? 'S' : 'T');
+        abuf_append(ab, buf, len);
+        if (d > 0) editor_draw_rows(ab, w, w->rows - d, w->rows);
+        else editor_draw_rows(ab, w, 0, -d);
+    } else {
+        full = 1;
+        editor_draw_rows(ab, w, 0, w->rows);
+    }
+    w->drawn = 1;
+    w->drawn_buf = w->buf;
+    w->drawn_version = w->buf->version;
+    w->drawn_row_off = w->row_off;
+    w->drawn_clo_off = w->clo_off;
+    w->drawn_top = w->top;
+    w->drawn_left = w->left;
+    w->drawn_rows = w->rows;
+    w->drawn_cols = w->cols;
+    return full;
+}
+
 /**
  * @brief 编辑器绘制状态栏
  * @param ab 追加缓冲区
+ * @param w 窗口：状态栏位于其文本区下方
  */
-void editor_draw_status_bar(abuf_t *ab) {
+void editor_draw_status_bar(abuf_t *ab, ewin_t *w) {
+    char status[160], rstatus[80];
+    int len = snprintf(status, sizeof(status), "\x1b[%d;%dH",
+                       w->top + w->rows + 1, w->left + 1);
+    abuf_append(ab, status, len);
     abuf_append(ab, "\x1b[7m", 4);
-    char status[80], rstatus[80];
-    int len = snprintf(status, sizeof(status), "%.20s - %d lines %s",
-        ec.filename ? ec.filename : "[No Name]", ec.num_rows,
-        ec.dirty ? "(modified)" : "");
+    len = 0;
+    if (hud.on && w == ec.win)
+        len = hud_format(status, sizeof(status));
+    else {
+        if (ec.num_bufs > 1)
+            len = snprintf(status, sizeof(status), "[%d/%d] ",
+                editor_buf_index(w->buf) + 1, ec.num_bufs);
+        len += snprintf(status + len, sizeof(status) - len, "%.20s - %d lines %s",
+            w->buf->filename ? w->buf->filename : "[No Name]", w->buf->num_rows,
+            w->buf->dirty ? "(modified)" : "");
+    }
     int rlen = snprintf(rstatus, sizeof(rstatus), "%s | %d/%d",
-        ec.syntax ? ec.syntax->filetype : "NA", ec.cursor_y + 1, ec.num_rows);
-    if(len > ec.screen_cols) len = ec.screen_cols;
+        w->buf->syntax ? w->buf->syntax->filetype : "NA", w->cursor_y + 1, w->buf->num_rows);
+    if(len > w->cols) len = w->cols;
     abuf_append(ab, status, len);
-    while(len < ec.screen_cols) {
-        if(ec.screen_cols - len == rlen) {
+    while(len < w->cols) {
+        if(w->cols - len == rlen) {
             abuf_append(ab, rstatus, rlen);
             break;
         } else{
@@ -1110,7 +4359,27 @@ void editor_draw_status_bar(abuf_t *ab) {
         } // if
     } // while
     abuf_append(ab, "\x1b[m", 3);
-    abuf_append(ab, "\r\n", 2);
+}
+
+/**
+ * @brief 编辑器绘制左右分割的分隔线
+ * @param ab 追加缓冲区
+ * @param n 子树根节点
+ */
+void editor_draw_splits(abuf_t *ab, esplit_t *n) {
+    if (n->dir == SPLIT_NONE) return;
+    if (n->dir == SPLIT_V) {
+        char buf[32];
+        int col = n->a->left + n->a->cols + 1;
+        abuf_append(ab, "\x1b[7m", 4);
+        for (int y = 0; y < n->rows; y++) {
+            int len = snprintf(buf, sizeof(buf), "\x1b[%d;%dH|", n->top + y + 1, col);
+            abuf_append(ab, buf, len);
+        }
+        abuf_append(ab, "\x1b[m", 3);
+    }
+    editor_draw_splits(ab, n->a);
+    editor_draw_splits(ab, n->b);
 }
 
 /**
@@ -1118,7 +4387,9 @@ void editor_draw_status_bar(abuf_t *ab) {
  * @param ab 追加缓冲区
  */
 void editor_draw_status_msg(abuf_t *ab) {
-    abuf_append(ab, "\x1b[K", 3);
+    char buf[32];
+    int len = snprintf(buf, sizeof(buf), "\x1b[%d;1H\x1b[K", ec.screen_rows + 2);
+    abuf_append(ab, buf, len);
     int msg_len = strlen(ec.status_msg);
     if(msg_len > ec.screen_cols) msg_len = ec.screen_cols;
     if(msg_len && time(NULL) - ec.status_msg_time < 5)
@@ -1140,24 +4411,63 @@ void editor_set_status_msg(const char *fmt, ...) {
 
 /**
  * @brief 编辑器清除屏幕
+ * @note 一帧包在同步更新（`CSI ?2026 h`/`CSI ?2026 l`）中，支持的终端整帧一次呈现，
+ * 不支持的终端忽略这两个序列。
+ * 终端还没收完上一帧时不绘制本帧，只记下屏幕已落后（`output.stale`），
+ * 等积压的帧写完再绘制最新的状态，中间的帧全部丢弃，参考`term_poll`。
  */
 void editor_refresh_screen() {
-    editor_scroll();
+    TRACE_SCOPE("editor_refresh_screen");
+    if (!output_flush(0)) {
+        output.stale = 1;
+        if (hud_owner) hud.cur.drops++;
+        return;
+    }
+    int prev_stage = hud_enter(ST_DRAW);
+    editor_layout(ec.layout, 0, 0, ec.screen_rows + 1, ec.screen_cols);
+    for (int i = 0; i < ec.num_wins; i++) editor_scroll(ec.wins[i]);
     abuf_t ab = ABUF_INIT;
+    abuf_append(&ab, "\x1b[?2026h", 8);     // 开始同步更新
     abuf_append(&ab, "\x1b[?25l", 6);       // 处理光标闪烁
-    abuf_append(&ab, "\x1b[H"   , 3);       // 放置光标左上角
-    editor_draw_rows(&ab);
-    editor_draw_status_bar(&ab);
+    // 覆盖层或当前缓冲区改变时，屏幕上所有窗口的内容都不能沿用
+    int full = ec.redraw || ec.drawn_focus != ec.win->buf ||
+               memcmp(ec.drawn_overlay, ec.overlay, sizeof(ec.overlay)) != 0;
+    int splits = full;
+    for (int i = 0; i < ec.num_wins; i++) {
+        ewin_t *w = ec.wins[i];
+        editor_hl_sync(w->buf, w->row_off, w->row_off + w->rows);
+        splits |= editor_draw_window(&ab, w, full);
+        // 状态栏与消息栏内容不变时不再输出，只移动光标时一帧只有几十字节
+        int at = ab.len;
+        editor_draw_status_bar(&ab, w);
+        uint64_t h = hash_bytes(ab.b + at, ab.len - at);
+        if (!full && h == w->drawn_status) ab.len = at;
+        w->drawn_status = h;
+    }
+    if (splits) editor_draw_splits(&ab, ec.layout);
+    int at = ab.len;
     editor_draw_status_msg(&ab);
+    uint64_t h = hash_bytes(ab.b + at, ab.len - at);
+    if (!full && h == ec.drawn_msg) ab.len = at;
+    ec.drawn_msg = h;
+    ec.redraw = 0;
+    ec.drawn_focus = ec.win->buf;
+    memcpy(ec.drawn_overlay, ec.overlay, sizeof(ec.overlay));
     
     char buf[32];
-    snprintf(buf, sizeof(buf), "\x1b[%d;%dH", (ec.cursor_y - ec.row_off) + 1, 
-                                              (ec.render_x - ec.clo_off) + 1);
+    ewin_t *w = ec.win;
+    snprintf(buf, sizeof(buf), "\x1b[%d;%dH", w->top + (w->cursor_y - w->row_off) + 1,
+                                              w->left + (w->render_x - w->clo_off) + 1);
     abuf_append(&ab, buf, strlen(buf));     // 放置光标到 (x, y)
 
     abuf_append(&ab, "\x1b[?25h", 6);
-    write(STDOUT_FILENO, ab.b, ab.len);
-    abuf_free(&ab);
+    abuf_append(&ab, "\x1b[?2026l", 8);     // 结束同步更新
+    hud_enter(ST_WRITE);
+    output.ab = ab;
+    output.stale = 0;
+    output_flush(0);
+    hud_commit(ab.len);
+    hud_enter(prev_stage);
 }
 
 
@@ -1180,7 +4490,7 @@ char *editor_prompt(char *prompt, void (*callback)(char *, int)) {
     buf[0] = '\0';
     while(1) {
         editor_set_status_msg(prompt, buf);
-        editor_refresh_screen();
+        if (!input_pending()) editor_refresh_screen();
         int c = editor_read_key();
         if(c == DEL_KEY || c == CTRL_KEY('h') || c == BACK_SPACE) {
             if(buflen != 0) buf[--buflen] = '\0';
@@ -1212,59 +4522,92 @@ char *editor_prompt(char *prompt, void (*callback)(char *, int)) {
  * @param key 键入字符
  */
 void editor_move_cursor(int key) {
-    erow_t *row = (ec.cursor_y >= ec.num_rows) ? NULL : &ec.row[ec.cursor_y];
+    erow_t *row = (ec.win->cursor_y >= ec.win->buf->num_rows) ? NULL : &ec.win->buf->row[ec.win->cursor_y];
     switch (key){
     case ARROW_LEFT:
-        if(ec.cursor_x != 0) { 
-            ec.cursor_x--;
-        } else if(ec.cursor_y > 0) {
+        if(ec.win->cursor_x != 0) { 
+            ec.win->cursor_x = editor_row_prev_char(row, ec.win->cursor_x);
+        } else if(ec.win->cursor_y > 0) {
             // 允许左移到上一行末尾
-            ec.cursor_y--;
-            ec.cursor_x = ec.row[ec.cursor_y].len;
+            ec.win->cursor_y--;
+            ec.win->cursor_x = ec.win->buf->row[ec.win->cursor_y].len;
         }
         break;
     case ARROW_RIGHT:
-        if(row && ec.cursor_x < row->len) {
-            ec.cursor_x++;
-        } else if(row && ec.cursor_x == row->len) {
+        if(row && ec.win->cursor_x < row->len) {
+            ec.win->cursor_x = editor_row_next_char(row, ec.win->cursor_x);
+        } else if(row && ec.win->cursor_x == row->len) {
             // 允许右移到下一行开头
-            ec.cursor_y++;
-            ec.cursor_x = 0;
+            ec.win->cursor_y++;
+            ec.win->cursor_x = 0;
         }
         break;
     case ARROW_UP:
-        if (ec.cursor_y != 0) ec.cursor_y--;
+        if (ec.win->cursor_y != 0) ec.win->cursor_y--;
         break;
     case ARROW_DOWN:
-        if (ec.cursor_y < ec.num_rows) ec.cursor_y++;
+        if (ec.win->cursor_y < ec.win->buf->num_rows) ec.win->cursor_y++;
         break;
     default:
         break;
     }
-    // 将光标对齐到行尾
-    row = (ec.cursor_y >= ec.num_rows) ? NULL : &ec.row[ec.cursor_y];
+    // 将光标对齐到行尾与字符起点
+    row = (ec.win->cursor_y >= ec.win->buf->num_rows) ? NULL : &ec.win->buf->row[ec.win->cursor_y];
     int row_len = row ? row->len : 0;
-    if(ec.cursor_x > row_len) ec.cursor_x = row_len;
+    if(ec.win->cursor_x > row_len) ec.win->cursor_x = row_len;
+    if(row) ec.win->cursor_x = editor_row_char_start(row, ec.win->cursor_x);
 }
 
+/**
+ * @brief 编辑器处理鼠标事件
+ * @note 左键单击把光标移到所点的位置（并切换到所在窗口），滚轮每格移动三行。
+ */
+void editor_mouse() {
+    emouse_t *m = &input.mouse;
+    if (m->button & 64) {
+        int key = (m->button & 1) ? ARROW_DOWN : ARROW_UP;
+        for (int i = 0; i < 3; i++) editor_move_cursor(key);
+        return;
+    }
+    if (m->button != 0 || !m->press) return;
+    for (int i = 0; i < ec.num_wins; i++) {
+        ewin_t *w = ec.wins[i];
+        if (m->y < w->top || m->y >= w->top + w->rows ||
+            m->x < w->left || m->x >= w->left + w->cols)
+            continue;
+        ec.win = w;
+        w->cursor_y = w->row_off + m->y - w->top;
+        if (w->cursor_y > w->buf->num_rows) w->cursor_y = w->buf->num_rows;
+        w->cursor_x = 0;
+        if (w->cursor_y < w->buf->num_rows)
+            w->cursor_x = editor_row_rx2cx(&w->buf->row[w->cursor_y],
+                                           w->clo_off + m->x - w->left);
+        editor_move_cursor(0);
+        return;
+    }
+}
 
 /**
  * @brief 编辑器处理键入
+ * @note 带修饰键的功能键按不带修饰键处理，`Alt`组合键与未绑定的功能键忽略。
  */
 void editor_proc_key() {
     static int quit_times = QUIT_TIMES;
     int c = editor_read_key();
+    if (c & (KEY_SHIFT | KEY_ALT | KEY_CTRL))
+        c = KEY_CODE(c) >= ARROW_LEFT && !(c & KEY_ALT) ? KEY_CODE(c) : KEY_UNKNOWN;
     switch (c) {
     case '\r':
         editor_insert_newline();
         break;
     case CTRL_KEY('q'):
-        if(ec.dirty && quit_times > 0) {
+        if(editor_bufs_dirty() && quit_times > 0) {
             editor_set_status_msg("WARN: File has changes. "
             "Press Ctrl-Q %d more times to unsaved quit.", quit_times);
             quit_times--;
             return;
         }
+        output_flush(1);
         write(STDOUT_FILENO, "\x1b[2J", 4);         // 清除屏幕
         write(STDOUT_FILENO, "\x1b[H" , 3);         // 定位左上角
         exit(0);
@@ -1275,7 +4618,32 @@ void editor_proc_key() {
     case CTRL_KEY('f'):
         editor_find();
         break;
+    case CTRL_KEY('t'):
+        hud.on = !hud.on;
+        break;
+    case CTRL_KEY('w'):
+        // 窗口命令前缀：s 上下分割，v 左右分割，w 下一个窗口，c 关闭
+        switch (editor_read_key()) {
+        case 's': editor_win_split(SPLIT_H); break;
+        case 'v': editor_win_split(SPLIT_V); break;
+        case 'w': case CTRL_KEY('w'): editor_win_next(); break;
+        case 'c': editor_win_close(); break;
+        default: break;
+        }
+        break;
+    case CTRL_KEY('n'):
+        editor_buf_switch(editor_buf_index(ec.win->buf) + 1);
+        break;
+    case CTRL_KEY('p'):
+        editor_buf_switch(editor_buf_index(ec.win->buf) - 1);
+        break;
+    case MOUSE_EVENT:
+        editor_mouse();
+        break;
     case CTRL_KEY('l'):
+        // 帧是增量绘制的：屏幕被其他程序的输出弄乱时由用户要求整屏重绘
+        ec.redraw = 1;
+        break;
     case '\x1b':
         /// TODO: 处理特殊字符
         break;
@@ -1295,29 +4663,31 @@ void editor_proc_key() {
         editor_move_cursor(c);
         break;
     case HOME_KEY:
-        ec.cursor_x = 0;
+        ec.win->cursor_x = 0;
         break;
     case END_KEY:
         // 移动到当前行的尾行
-        if (ec.cursor_y < ec.num_rows)
-            ec.cursor_x = ec.row[ec.cursor_y].len;
+        if (ec.win->cursor_y < ec.win->buf->num_rows)
+            ec.win->cursor_x = ec.win->buf->row[ec.win->cursor_y].len;
         break;
     case PAGE_UP:
     case PAGE_DOWN:
         {
+            // 同一帧内连续翻页时行偏移尚未随上一次翻页更新，先按光标滚动
+            editor_scroll(ec.win);
             if(c == PAGE_UP) {
-                ec.cursor_y = ec.row_off;
+                ec.win->cursor_y = ec.win->row_off;
             } else if (c == PAGE_DOWN) {
-                ec.cursor_y = ec.row_off + ec.screen_rows - 1;
-                if (ec.cursor_y > ec.num_rows) ec.cursor_y = ec.num_rows;
+                ec.win->cursor_y = ec.win->row_off + ec.win->rows - 1;
+                if (ec.win->cursor_y > ec.win->buf->num_rows) ec.win->cursor_y = ec.win->buf->num_rows;
             }
-            int times = ec.screen_rows;
+            int times = ec.win->rows;
             while(times--)
                 editor_move_cursor(c == PAGE_UP ? ARROW_UP : ARROW_DOWN);
         }
         break;
     default:
-        editor_insert_char(c);
+        if (c < ARROW_LEFT) editor_insert_char(c);
         break;
     }
     quit_times = QUIT_TIMES;
@@ -1331,22 +4701,27 @@ void editor_proc_key() {
  * @brief 编辑器初始化
  */
 void editor_init() {
-    ec.cursor_x = 0;
-    ec.cursor_y = 0;
-    ec.render_x = 0;
-    ec.render_y = 0;
-    ec.num_rows = 0;
-    ec.row_off  = 0;
-    ec.clo_off  = 0;
-    ec.dirty    = 0;
-    ec.row      = NULL;
-    ec.filename = NULL;
-    ec.syntax   = NULL;
+    ec.bufs = NULL;
+    ec.num_bufs = 0;
+    ec.win = editor_win_new(editor_buf_new());
+    editor_buf_add(ec.win->buf);
+    ec.layout = editor_split_new(ec.win);
+    ec.wins = NULL;
+    editor_win_list();
+    for (int o = 0; o < OV_NUM; o++) ec.overlay[o].row = -1;
+    ec.redraw = 1;
     ec.status_msg[0] = '\0';
     ec.status_msg_time = 0;
+    hud_owner = 1;
+    hud.stage = ST_EDIT;
+    hud.stamp = now_ns();
+    const char *fps = getenv("TEXC_FPS");
+    int rate = fps ? atoi(fps) : FRAME_RATE;
+    ec.frame_ns = rate > 0 ? 1000000000ull / rate : 0;
     if(get_window_size(&ec.screen_rows, &ec.screen_cols) == -1)
         fatal("get_window_size");
     ec.screen_rows -= 2;
+    fcntl(STDOUT_FILENO, F_SETFL, output.flags | O_NONBLOCK);   // 参考`output_flush`
 }
 
 
@@ -1355,15 +4730,40 @@ void editor_init() {
 // ======================================================================= //
 
 int main(int argc, char* argv[]) {
+    trace_init();
     enable_raw_mode();
     editor_init();
+    char syn_err[80];
+    int syn_errors = syn_load(syn_err, sizeof(syn_err));
     if(argc >= 2) {
         editor_open(argv[1]);
     }
-    editor_set_status_msg("HELP: Ctrl-S = save | Ctrl-Q = quit | Ctrl-F = find");
+    for (int i = 2; i < argc; i++) {
+        ebuf_t *b = editor_buf_new();
+        if (editor_buf_open(b, argv[i]) == -1) fatal("fopen");
+        editor_buf_add(b);
+    }
+    if (ec.num_bufs > 1)
+        editor_set_status_msg("HELP: Ctrl-S = save | Ctrl-Q = quit | Ctrl-F = find | "
+                              "Ctrl-N/P = next/prev file | Ctrl-T = hud");
+    else
+        editor_set_status_msg("HELP: Ctrl-S = save | Ctrl-Q = quit | Ctrl-F = find | Ctrl-T = hud");
+    if (syn_errors)
+        editor_set_status_msg("%s (%d errors)", syn_err, syn_errors);
+    const char *theme = getenv("TEXC_THEME");
+    if (theme_load(theme, theme_detect()) == -1)
+        editor_set_status_msg("Unknown theme: %s", theme);
     while(1) {
+        // 先处理完已到达的全部按键再重绘：连续按键只绘制一帧。
+        // 距上一帧不足最短帧间隔时继续等待并处理新到的按键，
+        // 但输入持续到达时至多推迟`FRAME_LAG_MS`毫秒，保证画面仍在刷新。
         editor_refresh_screen();
+        uint64_t frame = now_ns();
         editor_proc_key();
+        uint64_t start = now_ns();
+        while (now_ns() - start < FRAME_LAG_MS * 1000000ull &&
+               (input_pending() || input_wait(frame + ec.frame_ns)))
+            editor_proc_key();
     }
     return 0;
 }
@@ -5,6 +5,7 @@ set_languages("c99", "c++11")
 target("texc")
     set_kind("binary")
     add_files("src/*.c")
+    add_syslinks("pthread")
 
 
 --